@@ -0,0 +1,510 @@
+// dup and fdopen are outside of c11
+#define _DEFAULT_SOURCE
+#include "../src/common.h"
+#include "../src/parser.h"
+#include "../src/scanner.h"
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+  Lexes and parses generated corpora a number of times and reports the
+  median throughput of both phases with the spread of the runs. Every
+  corpus leans on one thing, the sources are the same for the same seed
+  and size and only use what the parser understands.
+
+    bench_compiler [--size MB] [--runs N] [--seed S] [--corpus CORPUS] [--json FILE] [--baseline FILE]
+    bench_compiler --emit CORPUS [--size MB] [--seed S]
+
+  --corpus runs only that one, --emit writes it to stdout instead. Given a baseline written by
+  --json, a median more than REGRESSION_THRESHOLD below it is reported and
+  the exit code is 1.
+*/
+
+#define DEFAULT_CORPUS_SIZE  (4 * 1024 * 1024)
+#define DEFAULT_RUNS         9
+#define REGRESSION_THRESHOLD 0.10
+
+typedef struct
+{
+  String source;
+  u64    capacity;
+  u32    seed;
+  u32    count; // of top level items, names them apart
+} Generator;
+
+static u32 random_below(Generator* gen, u32 n)
+{
+  gen->seed = gen->seed * 1664525 + 1013904223;
+  return (gen->seed >> 8) % n;
+}
+
+static void emit(Generator* gen, const char* format, ...)
+{
+  for (;;)
+  {
+    va_list args;
+    va_start(args, format);
+    u64 space = gen->capacity - gen->source.len;
+    i32 len   = vsnprintf(&gen->source.buffer[gen->source.len], space, format, args);
+    va_end(args);
+    // the 0 vsnprintf leaves after the text is the one the scanner needs
+    if ((u64)len < space)
+    {
+      gen->source.len += len;
+      return;
+    }
+    gen->capacity      = gen->capacity * 2 + len;
+    gen->source.buffer = realloc(gen->source.buffer, gen->capacity);
+  }
+}
+
+static const char* words[] = {"token", "arena", "parser", "node",  "buffer", "scanner", "index", "count",
+                              "value", "next",  "symbol", "table", "offset", "string",  "line",  "chunk"};
+
+static void emit_operand(Generator* gen)
+{
+  switch (random_below(gen, 6))
+  {
+  case 0:
+    emit(gen, "%u", random_below(gen, 100000));
+    break;
+  case 1:
+    emit(gen, "0x%X", random_below(gen, 1 << 24));
+    break;
+  case 2:
+    emit(gen, "%u.%ue%u", random_below(gen, 100), random_below(gen, 1000), random_below(gen, 10));
+    break;
+  case 3:
+    emit(gen, "%s++", words[random_below(gen, ArrayCount(words))]);
+    break;
+  default:
+    emit(gen, "%s", words[random_below(gen, ArrayCount(words))]);
+  }
+}
+
+static void emit_expression(Generator* gen, u32 terms)
+{
+  static const char* operators[] = {" + ", " * ", " / ", " + ", " * ", " < ", " == ", " >= "};
+  emit_operand(gen);
+  for (u32 i = 1; i < terms; i++)
+  {
+    emit(gen, "%s", operators[random_below(gen, ArrayCount(operators))]);
+    emit_operand(gen);
+  }
+}
+
+// long operator chains, most of the tokens are operands and operators
+static void generate_expressions(Generator* gen)
+{
+  emit(gen, "int expression_%u(int token, int arena, int parser)\n{\n", gen->count);
+  for (u32 i = 0, count = 2 + random_below(gen, 4); i < count; i++)
+  {
+    emit(gen, "  int value_%u = ", i);
+    emit_expression(gen, 16 + random_below(gen, 48));
+    emit(gen, ";\n");
+  }
+  emit(gen, "  return ");
+  emit_expression(gen, 8 + random_below(gen, 16));
+  emit(gen, ";\n}\n");
+}
+
+// many variables per declaration
+static void generate_declarations(Generator* gen)
+{
+  static const char* types[] = {"int", "long", "unsigned int", "float", "double"};
+  emit(gen, "%s", types[random_below(gen, ArrayCount(types))]);
+  for (u32 i = 0, count = 16 + random_below(gen, 48); i < count; i++)
+  {
+    emit(gen, "%s declared_%u_%u", i ? "," : "", gen->count, i);
+    if (random_below(gen, 4))
+    {
+      emit(gen, " = ");
+      emit_operand(gen);
+    }
+  }
+  emit(gen, ";\n");
+}
+
+static void generate_statements(Generator* gen, u32 depth)
+{
+  for (u32 i = 0, count = 1 + random_below(gen, 4); i < count; i++)
+  {
+    switch (depth < 3 ? random_below(gen, 5) : 0)
+    {
+    case 0:
+    case 1:
+      emit(gen, "%*sint local_%u_%u = ", depth * 2, "", depth, i);
+      emit_expression(gen, 1 + random_below(gen, 6));
+      emit(gen, ";\n");
+      break;
+    case 2:
+      emit(gen, "%*sif (%s < %u)\n%*s{\n", depth * 2, "", words[random_below(gen, ArrayCount(words))], random_below(gen, 100), depth * 2, "");
+      generate_statements(gen, depth + 1);
+      emit(gen, "%*s}\n%*selse\n%*s{\n", depth * 2, "", depth * 2, "", depth * 2, "");
+      generate_statements(gen, depth + 1);
+      emit(gen, "%*s}\n", depth * 2, "");
+      break;
+    case 3:
+      emit(gen, "%*swhile (%s < %u)\n%*s{\n", depth * 2, "", words[random_below(gen, ArrayCount(words))], random_below(gen, 100), depth * 2, "");
+      generate_statements(gen, depth + 1);
+      emit(gen, "%*s%s++;\n%*s}\n", depth * 2 + 2, "", words[random_below(gen, ArrayCount(words))], depth * 2, "");
+      break;
+    case 4:
+      emit(gen, "%*sreturn ", depth * 2, "");
+      emit_expression(gen, 1 + random_below(gen, 4));
+      emit(gen, ";\n");
+      break;
+    }
+  }
+}
+
+// small functions with nested control flow
+static void generate_functions(Generator* gen)
+{
+  emit(gen, "int function_%u(int token, long arena, float parser)\n{\n", gen->count);
+  generate_statements(gen, 1);
+  emit(gen, "  return token;\n}\n");
+}
+
+// mostly comments, the lexer skips them and the parser never sees them
+static void generate_comments(Generator* gen)
+{
+  bool block = random_below(gen, 2);
+  emit(gen, block ? "/*\n" : "");
+  for (u32 line = 0, lines = 1 + random_below(gen, 8); line < lines; line++)
+  {
+    emit(gen, block ? " *" : "//");
+    for (u32 i = 0, count = 4 + random_below(gen, 12); i < count; i++)
+    {
+      emit(gen, " %s", words[random_below(gen, ArrayCount(words))]);
+    }
+    emit(gen, "\n");
+  }
+  emit(gen, block ? " */\n" : "");
+  emit(gen, "int commented_%u = %u;\n", gen->count, random_below(gen, 1000));
+}
+
+// long literals with escapes, decoded and copied into the strings table
+static void generate_strings(Generator* gen)
+{
+  static const char* escapes[] = {"\\t", "\\n", "\\\"", "\\\\", "\\x41", "\\101"};
+  emit(gen, "int* string_%u = \"", gen->count);
+  for (u32 i = 0, count = 4 + random_below(gen, 32); i < count; i++)
+  {
+    emit(gen, "%s%s", words[random_below(gen, ArrayCount(words))], random_below(gen, 4) ? " " : escapes[random_below(gen, ArrayCount(escapes))]);
+  }
+  emit(gen, "\";\n");
+}
+
+typedef struct
+{
+  const char* name;
+  void (*generate)(Generator* gen);
+} CorpusKind;
+
+static CorpusKind corpus_kinds[] = {
+    {"expressions",  generate_expressions},
+    {"declarations", generate_declarations},
+    {"functions",    generate_functions},
+    {"comments",     generate_comments},
+    {"strings",      generate_strings},
+};
+
+static String generate_corpus(CorpusKind* kind, u64 size, u32 seed)
+{
+  Generator gen = {.capacity = 4096, .seed = seed};
+  gen.source.buffer = malloc(gen.capacity);
+  while (gen.source.len < size)
+  {
+    kind->generate(&gen);
+    gen.count++;
+  }
+  return gen.source;
+}
+
+typedef struct
+{
+  f64 median; // seconds
+  f64 spread; // standard deviation over the mean
+} Timing;
+
+static i32 compare_seconds(const void* a, const void* b)
+{
+  f64 first  = *(const f64*)a;
+  f64 second = *(const f64*)b;
+  return first < second ? -1 : first > second;
+}
+
+static Timing summarize(f64* seconds, u32 runs)
+{
+  f64 mean = 0, variance = 0;
+  for (u32 i = 0; i < runs; i++)
+  {
+    mean += seconds[i] / runs;
+  }
+  for (u32 i = 0; i < runs; i++)
+  {
+    variance += (seconds[i] - mean) * (seconds[i] - mean) / runs;
+  }
+  qsort(seconds, runs, sizeof(f64), compare_seconds);
+  f64 median = runs % 2 ? seconds[runs / 2] : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+  return (Timing){.median = median, .spread = sqrt(variance) / mean};
+}
+
+typedef struct
+{
+  const char* corpus;
+  const char* phase;
+  u64         bytes;
+  u64         items; // tokens lexed or nodes parsed
+  const char* item_name;
+  Timing      timing;
+} Result;
+
+static f64 megabytes_per_second(Result* result)
+{
+  return result->bytes / result->timing.median / (1024.0 * 1024.0);
+}
+
+static void print_result(FILE* report, Result* result)
+{
+  fprintf(report, "%-13s %-6s %8.2f MB/s %9.2f M %s/s  +-%5.2f%%\n", result->corpus, result->phase, megabytes_per_second(result),
+          result->items / result->timing.median / 1e6, result->item_name, 100.0 * result->timing.spread);
+}
+
+static void bench_corpus(Arena* arena, CorpusKind* kind, String* source, u32 runs, Result* lexed, Result* parsed)
+{
+  f64 lex_seconds[runs];
+  f64 parse_seconds[runs];
+  u64 cpuFreq = EstimateCPUTimerFreq();
+  for (u32 run = 0; run < runs; run++)
+  {
+    ArenaMarker marker = sta_arena_save(arena);
+    Scanner     scanner;
+    TokenBuffer tokens;
+    Parser      parser;
+    init_scanner(&scanner, arena, source, kind->name);
+
+    u64 start = ReadCPUTimer();
+    scan_tokens(&scanner, &tokens);
+    u64 middle = ReadCPUTimer();
+    init_parser(&parser, &scanner, &tokens);
+    parse(&parser);
+    u64 end            = ReadCPUTimer();
+    free_parser(&parser);
+
+    lex_seconds[run]   = (middle - start) / (f64)cpuFreq;
+    parse_seconds[run] = (end - middle) / (f64)cpuFreq;
+    *lexed             = (Result){kind->name, "lex", source->len, tokens.count, "tokens"};
+    *parsed            = (Result){kind->name, "parse", source->len, parser.ast.count - 1, "nodes"};
+    sta_arena_restore(marker);
+  }
+  lexed->timing  = summarize(lex_seconds, runs);
+  parsed->timing = summarize(parse_seconds, runs);
+}
+
+static bool write_results(const char* filename, Result* results, u32 count, u64 size, u32 seed, u32 runs)
+{
+  FILE* file = fopen(filename, "w");
+  if (!file)
+  {
+    return false;
+  }
+  fprintf(file, "{\"size\": %lu, \"seed\": %u, \"runs\": %u, \"results\": [\n", size, seed, runs);
+  for (u32 i = 0; i < count; i++)
+  {
+    Result* result = &results[i];
+    fprintf(file,
+            "  {\"corpus\": \"%s\", \"phase\": \"%s\", \"bytes\": %lu, \"%s\": %lu, \"median_seconds\": %.9f, \"mb_per_second\": %.3f, "
+            "\"%s_per_second\": %.1f, \"spread\": %.5f}%s\n",
+            result->corpus, result->phase, result->bytes, result->item_name, result->items, result->timing.median, megabytes_per_second(result),
+            result->item_name, result->items / result->timing.median, result->timing.spread, i + 1 < count ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  return fclose(file) == 0;
+}
+
+// reads what write_results wrote, one result to a line
+static bool compare_baseline(FILE* report, const char* filename, Result* results, u32 count)
+{
+  FILE* file = fopen(filename, "r");
+  if (!file)
+  {
+    fprintf(report, "Couldn't read baseline %s\n", filename);
+    return false;
+  }
+
+  bool passed = true;
+  char line[1024];
+  fprintf(report, "\nAgainst %s:\n", filename);
+  while (fgets(line, sizeof(line), file))
+  {
+    char  corpus[64], phase[64];
+    char* speed = strstr(line, "\"mb_per_second\": ");
+    if (!speed || sscanf(line, " {\"corpus\": \"%63[^\"]\", \"phase\": \"%63[^\"]\"", corpus, phase) != 2)
+    {
+      continue;
+    }
+    f64 baseline = strtod(speed + strlen("\"mb_per_second\": "), 0);
+    for (u32 i = 0; i < count; i++)
+    {
+      if (strcmp(corpus, results[i].corpus) == 0 && strcmp(phase, results[i].phase) == 0)
+      {
+        f64  change = megabytes_per_second(&results[i]) / baseline - 1.0;
+        bool slower = change < -REGRESSION_THRESHOLD;
+        passed &= !slower;
+        fprintf(report, "%-13s %-6s %+7.2f%%%s\n", corpus, phase, 100.0 * change, slower ? "  REGRESSION" : "");
+      }
+    }
+  }
+  fclose(file);
+  return passed;
+}
+
+static CorpusKind* find_corpus(const char* name)
+{
+  for (u32 i = 0; i < ArrayCount(corpus_kinds); i++)
+  {
+    if (strcmp(corpus_kinds[i].name, name) == 0)
+    {
+      return &corpus_kinds[i];
+    }
+  }
+  return 0;
+}
+
+static const char* options[] = {"--size", "--runs", "--seed", "--json", "--baseline", "--emit", "--corpus"};
+
+static bool is_option(const char* arg)
+{
+  for (u32 i = 0; i < ArrayCount(options); i++)
+  {
+    if (strcmp(options[i], arg) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int usage(const char* problem, const char* option)
+{
+  printf("%s %s\n", problem, option);
+  printf("usage: bench_compiler [--size MB] [--runs N] [--seed S] [--corpus CORPUS] [--json FILE] [--baseline FILE]\n");
+  printf("       bench_compiler --emit CORPUS [--size MB] [--seed S]\n");
+  return 1;
+}
+
+int main(int argc, char** argv)
+{
+  u64         size     = DEFAULT_CORPUS_SIZE;
+  u32         runs     = DEFAULT_RUNS;
+  u32         seed     = 1;
+  const char* json     = 0;
+  const char* baseline = 0;
+  const char* emitted  = 0;
+  const char* only     = 0;
+  for (i32 i = 1; i < argc; i++)
+  {
+    const char* option = argv[i];
+    if (!is_option(option))
+    {
+      return usage("Unknown option", option);
+    }
+    // every option takes a value, another option in its place is a missing one
+    if (i + 1 == argc || strncmp(argv[i + 1], "--", 2) == 0)
+    {
+      return usage("Missing value for", option);
+    }
+    const char* value = argv[++i];
+    if (strcmp(option, "--size") == 0)
+    {
+      size = strtod(value, 0) * 1024 * 1024;
+    }
+    else if (strcmp(option, "--runs") == 0)
+    {
+      runs = MAX(atoi(value), 1);
+    }
+    else if (strcmp(option, "--seed") == 0)
+    {
+      seed = atoi(value);
+    }
+    else if (strcmp(option, "--json") == 0)
+    {
+      json = value;
+    }
+    else if (strcmp(option, "--baseline") == 0)
+    {
+      baseline = value;
+    }
+    else if (strcmp(option, "--emit") == 0)
+    {
+      emitted = value;
+    }
+    else if (strcmp(option, "--corpus") == 0)
+    {
+      only = value;
+    }
+  }
+
+  if (emitted)
+  {
+    CorpusKind* kind = find_corpus(emitted);
+    if (!kind)
+    {
+      printf("Unknown corpus %s\n", emitted);
+      return 1;
+    }
+    String source = generate_corpus(kind, size, seed);
+    fwrite(source.buffer, 1, source.len, stdout);
+    free(source.buffer);
+    return 0;
+  }
+  if (only && !find_corpus(only))
+  {
+    printf("Unknown corpus %s\n", only);
+    return 1;
+  }
+
+  // the parser traces every token it reads to stdout, that is part of what
+  // it costs but not something to read
+  FILE* report = fdopen(dup(STDOUT_FILENO), "w");
+  freopen("/dev/null", "w", stdout);
+
+  Arena arena = {};
+  sta_arena_init_virtual(&arena, ARENA_RESERVE_SIZE);
+  Result results[ArrayCount(corpus_kinds) * 2];
+  u32    count = 0;
+  fprintf(report, "%u runs of %.2f MB corpora, seed %u\n", runs, size / (1024.0 * 1024.0), seed);
+  for (u32 i = 0; i < ArrayCount(corpus_kinds); i++)
+  {
+    if (only && strcmp(only, corpus_kinds[i].name) != 0)
+    {
+      continue;
+    }
+    String source = generate_corpus(&corpus_kinds[i], size, seed + i);
+    bench_corpus(&arena, &corpus_kinds[i], &source, runs, &results[count], &results[count + 1]);
+    print_result(report, &results[count]);
+    print_result(report, &results[count + 1]);
+    fflush(report);
+    count += 2;
+    free(source.buffer);
+  }
+
+  bool passed = true;
+  if (json && !write_results(json, results, count, size, seed, runs))
+  {
+    fprintf(report, "Couldn't write %s\n", json);
+    passed = false;
+  }
+  if (baseline)
+  {
+    passed &= compare_baseline(report, baseline, results, count);
+  }
+  fclose(report);
+  sta_arena_free(&arena);
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#include "../src/common.h"
+#include "../src/files.h"
+#include "../src/jobs.h"
+#include "../src/scanner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+  Lexes a corpus of files, one job per file, with 1, 2, 4 ... workers up to
+  the number of cores and reports how the throughput scales. The files are
+  the arguments, without any a synthetic corpus is generated.
+*/
+
+#define SYNTHETIC_FILE_COUNT 64
+#define SYNTHETIC_FILE_SIZE  (512 * 1024)
+#define RUNS                 5
+
+typedef struct
+{
+  String source;
+  u32    token_count;
+} CorpusFile;
+
+static void lex_file(void* data, Arena* arena)
+{
+  CorpusFile* file   = data;
+  ArenaMarker marker = sta_arena_save(arena);
+  Scanner     scanner;
+  TokenBuffer tokens;
+  init_scanner(&scanner, arena, &file->source, "bench.jc");
+  scan_tokens(&scanner, &tokens);
+  file->token_count = tokens.count;
+  sta_arena_restore(marker);
+}
+
+static void generate_file(String* source, u32 seed)
+{
+  const char* lines[] = {
+      "int count_%u = 0x%xu;\n",
+      "static f64 scale_%u(f64 value) { return value * %u.25e-3; }\n",
+      "  if (node_%u->next != 0 && node_%u->count >= 16) { total += node_%u->count; }\n",
+      "  char* message_%u = \"entry %u\\tdone\\n\"; // logged once\n",
+      "  for (int i = 0; i < %u; i++) { buffer[i] = (u8)(i * 31 + 7); }\n",
+      "/* block %u, kept short */ struct Entry_%u { u32 key; u64 value; };\n",
+  };
+  // sprintf leaves the 0 the scanner wants after the last byte
+  source->buffer = malloc(SYNTHETIC_FILE_SIZE + 256);
+  source->len    = 0;
+  while (source->len < SYNTHETIC_FILE_SIZE)
+  {
+    seed = seed * 1664525 + 1013904223;
+    u32 n = seed >> 20;
+    source->len += sprintf(&source->buffer[source->len], lines[(seed >> 8) % ArrayCount(lines)], n, n, n);
+  }
+}
+
+static f64 run(JobSystem* jobs, CorpusFile* files, u32 file_count, u64 cpuFreq)
+{
+  u64 best = ~0ull;
+  for (u32 run = 0; run < RUNS; run++)
+  {
+    u64 start = ReadCPUTimer();
+    parallel_for(jobs, files, file_count, sizeof(CorpusFile), lex_file);
+    best = MIN(best, ReadCPUTimer() - start);
+  }
+  return best / (f64)cpuFreq;
+}
+
+int main(int argc, char** argv)
+{
+  u32         file_count = argc > 1 ? argc - 1 : SYNTHETIC_FILE_COUNT;
+  CorpusFile* files      = calloc(file_count, sizeof(CorpusFile));
+  u64         bytes      = 0;
+  for (u32 i = 0; i < file_count; i++)
+  {
+    if (argc > 1)
+    {
+      if (!sta_map_file(&files[i].source, argv[i + 1]))
+      {
+        printf("Couldn't read file %s\n", argv[i + 1]);
+        return 1;
+      }
+    }
+    else
+    {
+      generate_file(&files[i].source, i + 1);
+    }
+    bytes += files[i].source.len;
+  }
+
+  u32 cores   = sysconf(_SC_NPROCESSORS_ONLN);
+  u64 cpuFreq = EstimateCPUTimerFreq();
+  f64 single  = 0;
+  printf("%u files, %.2f MB, %u cores\n", file_count, bytes / (1024.0 * 1024.0), cores);
+  for (u32 workers = 1;; workers = MIN(workers * 2, cores))
+  {
+    JobSystem jobs = {};
+    init_job_system(&jobs, workers);
+    f64 seconds = run(&jobs, files, file_count, cpuFreq);
+    shutdown_job_system(&jobs);
+
+    single = workers == 1 ? seconds : single;
+    printf("%3u workers: %8.2f MB/s, %5.2fx, %3.0f%% efficiency\n", workers, bytes / seconds / (1024.0 * 1024.0), single / seconds,
+           100.0 * single / seconds / workers);
+    if (workers == cores)
+    {
+      break;
+    }
+  }
+
+  for (u32 i = 0; i < file_count; i++)
+  {
+    if (argc > 1)
+    {
+      sta_unmap_file(&files[i].source);
+    }
+    else
+    {
+      free(files[i].source.buffer);
+    }
+  }
+  free(files);
+  return 0;
+}
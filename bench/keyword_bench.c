@@ -0,0 +1,76 @@
+#include "../src/common.h"
+#include "../src/scanner.h"
+#include <stdlib.h>
+#include <string.h>
+
+// the lookup get_keyword used before the perfect hash, kept as the baseline
+static TokenType get_keyword_linear(String literal)
+{
+  static const char* keywords[] = {"auto",   "break",  "case",    "char",   "const",    "continue", "default",  "do",       "double", "else",     "enum",      "extern", "float",
+                                   "for",    "goto",   "if",      "inline", "int",      "long",     "register", "restrict", "return", "short",    "signed",    "sizeof", "static",
+                                   "struct", "switch", "typedef", "union",  "unsigned", "void",     "volatile", "while",    "_Bool",  "_Complex", "_Imaginary"};
+  static TokenType   tokens[]   = {
+      TOKEN_AUTO,   TOKEN_BREAK,  TOKEN_CASE,    TOKEN_CHAR,   TOKEN_CONST,    TOKEN_CONTINUE, TOKEN_DEFAULT,  TOKEN_DO,       TOKEN_DOUBLE, TOKEN_ELSE,    TOKEN_ENUM,      TOKEN_EXTERN, TOKEN_FLOAT,
+      TOKEN_FOR,    TOKEN_GOTO,   TOKEN_IF,      TOKEN_INLINE, TOKEN_INT,      TOKEN_LONG,     TOKEN_REGISTER, TOKEN_RESTRICT, TOKEN_RETURN, TOKEN_SHORT,   TOKEN_SIGNED,    TOKEN_SIZEOF, TOKEN_STATIC,
+      TOKEN_STRUCT, TOKEN_SWITCH, TOKEN_TYPEDEF, TOKEN_UNION,  TOKEN_UNSIGNED, TOKEN_VOID,     TOKEN_VOLATILE, TOKEN_WHILE,    TOKEN_BOOL,   TOKEN_COMPLEX, TOKEN_IMAGINARY,
+  };
+  u32 number_of_keywords = ArrayCount(keywords);
+  for (u32 i = 0; i < number_of_keywords; i++)
+  {
+    if (literal.len == strlen(keywords[i]) && strncmp(keywords[i], literal.buffer, literal.len) == 0)
+    {
+      return tokens[i];
+    }
+  }
+  return TOKEN_IDENTIFIER;
+}
+
+#define IDENTIFIER_COUNT (1 << 20)
+#define RUNS             10
+
+typedef TokenType (*KeywordFn)(String literal);
+
+static f64 run(KeywordFn fn, String* identifiers, u64 cpuFreq)
+{
+  u64 best = ~0ull;
+  u64 sink = 0;
+  for (u32 run = 0; run < RUNS; run++)
+  {
+    u64 start = ReadCPUTimer();
+    for (u32 i = 0; i < IDENTIFIER_COUNT; i++)
+    {
+      sink += fn(identifiers[i]);
+    }
+    best = MIN(best, ReadCPUTimer() - start);
+  }
+  if (sink == 0)
+  {
+    printf("\n");
+  }
+  return IDENTIFIER_COUNT / (best / (f64)cpuFreq);
+}
+
+int main()
+{
+  // roughly the keyword/identifier mix of ordinary C code
+  const char* words[] = {"int",  "i",     "return", "if",    "node",    "count",   "char", "buffer", "const", "struct", "len",     "for",
+                         "void", "index", "while",  "arena", "unsigned", "parser", "else", "token",  "static", "size",  "current", "x"};
+
+  String*     identifiers = malloc(sizeof(String) * IDENTIFIER_COUNT);
+  u32         seed        = 1;
+  for (u32 i = 0; i < IDENTIFIER_COUNT; i++)
+  {
+    seed = seed * 1664525 + 1013904223;
+    sta_initString(&identifiers[i], words[(seed >> 16) % ArrayCount(words)]);
+  }
+
+  u64 cpuFreq = EstimateCPUTimerFreq();
+  f64 linear  = run(get_keyword_linear, identifiers, cpuFreq);
+  f64 hashed  = run(get_keyword, identifiers, cpuFreq);
+
+  printf("linear scan:  %8.2f M identifiers/s\n", linear / 1e6);
+  printf("perfect hash: %8.2f M identifiers/s (%.1fx)\n", hashed / 1e6, hashed / linear);
+
+  free(identifiers);
+  return 0;
+}
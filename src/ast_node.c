@@ -1,9 +1,91 @@
 #include "ast_node.h"
+#include "common.h"
 #include "parser.h"
 #include "token.h"
 #include <stdlib.h>
+#include <string.h>
 
-void debug_data_type(DataType type)
+/*
+  Every node is made from a token of its own, so given the number of
+  tokens the nodes never grow. What is reserved past the last node is
+  never written and the pages stay untouched. A streamed input doesn't
+  know its tokens up front and doubles like the other tables.
+*/
+void init_ast(Ast* ast, Arena* arena, Scanner* scanner, u32 capacity)
+{
+  ast->arena          = arena;
+  ast->scanner        = scanner;
+  ast->capacity       = MAX(capacity, 64);
+  ast->kinds          = sta_arena_push_array_tagged(arena, u8, ast->capacity, "Ast");
+  ast->tokens         = sta_arena_push_array_tagged(arena, Token, ast->capacity, "Ast");
+  ast->data           = sta_arena_push_array_tagged(arena, NodeData, ast->capacity, "Ast");
+  ast->extra_capacity = 64;
+  ast->extra          = sta_arena_push_array_tagged(arena, u32, ast->extra_capacity, "Ast");
+  ast->type_capacity  = 64;
+  ast->types          = sta_arena_push_array_tagged(arena, DataType, ast->type_capacity, "Ast");
+  ast->extra_count    = 0;
+  ast->type_count     = 0;
+  ast->root           = 0;
+  // index 0 is no node
+  ast->count          = 1;
+  ast->kinds[0]       = NODE_EMPTY;
+}
+
+static void grow_nodes(Ast* ast)
+{
+  u32       capacity = ast->capacity * 2;
+  u8*       kinds    = sta_arena_push_array_tagged(ast->arena, u8, capacity, "Ast");
+  Token*    tokens   = sta_arena_push_array_tagged(ast->arena, Token, capacity, "Ast");
+  NodeData* data     = sta_arena_push_array_tagged(ast->arena, NodeData, capacity, "Ast");
+  memcpy(kinds, ast->kinds, ast->count * sizeof(u8));
+  memcpy(tokens, ast->tokens, ast->count * sizeof(Token));
+  memcpy(data, ast->data, ast->count * sizeof(NodeData));
+  ast->kinds    = kinds;
+  ast->tokens   = tokens;
+  ast->data     = data;
+  ast->capacity = capacity;
+}
+
+NodeIndex push_node(Ast* ast, AstNodeType kind, Token token, u32 lhs, u32 rhs)
+{
+  if (ast->count == ast->capacity)
+  {
+    grow_nodes(ast);
+  }
+  NodeIndex node    = ast->count++;
+  ast->kinds[node]  = kind;
+  ast->tokens[node] = token;
+  ast->data[node]   = (NodeData){lhs, rhs};
+  return node;
+}
+
+u32 push_extra(Ast* ast, u32 value)
+{
+  if (ast->extra_count == ast->extra_capacity)
+  {
+    u32* extra = sta_arena_push_array_tagged(ast->arena, u32, ast->extra_capacity * 2, "Ast");
+    memcpy(extra, ast->extra, ast->extra_count * sizeof(u32));
+    ast->extra = extra;
+    ast->extra_capacity *= 2;
+  }
+  ast->extra[ast->extra_count] = value;
+  return ast->extra_count++;
+}
+
+u32 push_type(Ast* ast, DataType type)
+{
+  if (ast->type_count == ast->type_capacity)
+  {
+    DataType* types = sta_arena_push_array_tagged(ast->arena, DataType, ast->type_capacity * 2, "Ast");
+    memcpy(types, ast->types, ast->type_count * sizeof(DataType));
+    ast->types = types;
+    ast->type_capacity *= 2;
+  }
+  ast->types[ast->type_count] = type;
+  return ast->type_count++;
+}
+
+void debug_data_type(Ast* ast, DataType type)
 {
   switch (type.type)
   {
@@ -36,15 +118,21 @@ void debug_data_type(DataType type)
       break;
     }
     }
+    break;
   }
   case DATA_TYPE_FLOATING_POINT:
   {
+    break;
   }
   case DATA_TYPE_FUNCTION:
   {
+    break;
   }
   case DATA_TYPE_STRUCT:
   {
+    String name = symbol_name(&ast->scanner->symbols, type.strukt.symbol);
+    printf("%.*s", (i32)name.len, name.buffer);
+    break;
   }
   }
   for (int i = 0; i < type.depth; i++)
@@ -53,49 +141,46 @@ void debug_data_type(DataType type)
   }
   printf(" ");
 }
-void debug_argument(Argument argument)
-{
-}
 
-void debug_declaration(DeclarationNode declaration)
+static void debug_specifiers(u32 specifiers)
 {
-  if (declaration.type_qualifier != 0)
+  u32 type_qualifier    = specifiers & 0xFF;
+  u32 storage_specifier = specifiers >> 8;
+  if (type_qualifier != 0)
   {
-    if ((declaration.type_qualifier & TYPE_QUAL_CONST) != 0)
+    if ((type_qualifier & TYPE_QUAL_CONST) != 0)
     {
       printf("const ");
     }
-    if ((declaration.type_qualifier & TYPE_QUAL_RESTRICT) != 0)
+    if ((type_qualifier & TYPE_QUAL_RESTRICT) != 0)
     {
       printf("restrict ");
     }
-    if ((declaration.type_qualifier & TYPE_QUAL_VOLATILE) != 0)
+    if ((type_qualifier & TYPE_QUAL_VOLATILE) != 0)
     {
       printf("volatile ");
     }
   }
 
-  if (declaration.storage_specifier != 0)
+  if (storage_specifier != 0)
   {
-    if ((declaration.storage_specifier & STORAGE_REGISTER) != 0)
+    if ((storage_specifier & STORAGE_REGISTER) != 0)
     {
       printf("register ");
     }
-    else if ((declaration.storage_specifier & STORAGE_AUTO) != 0)
+    else if ((storage_specifier & STORAGE_AUTO) != 0)
     {
       printf("auto ");
     }
-    else if ((declaration.storage_specifier & STORAGE_STATIC) != 0)
+    else if ((storage_specifier & STORAGE_STATIC) != 0)
     {
       printf("static ");
     }
-    else if ((declaration.storage_specifier & STORAGE_EXTERN) != 0)
+    else if ((storage_specifier & STORAGE_EXTERN) != 0)
     {
       printf("extern ");
     }
   }
-
-  debug_data_type(declaration.type);
 }
 
 static inline void print_tabs(int tabs)
@@ -106,67 +191,96 @@ static inline void print_tabs(int tabs)
   }
 }
 
-void debug_node(AstNode* node, int tabs);
+static void debug_token_literal(Ast* ast, NodeIndex node)
+{
+  String literal = token_literal(ast->scanner, ast->tokens[node]);
+  printf("%.*s", (i32)literal.len, literal.buffer);
+}
 
-void debug_block(AstNode* block, int tabs)
+// every entry at the same depth, an empty list prints like a missing node
+static void debug_list(Ast* ast, u32 list, int tabs)
+{
+  u32 count = list_count(ast, list);
+  if (count == 0)
+  {
+    debug_node(ast, 0, tabs);
+  }
+  for (u32 i = 0; i < count; i++)
+  {
+    debug_node(ast, list_items(ast, list)[i], tabs);
+  }
+}
+
+static void debug_block(Ast* ast, u32 list, int tabs)
 {
   printf("{\n");
-  AstNode* curr = block;
-  debug_node(curr, tabs + 1);
+  debug_list(ast, list, tabs + 1);
   print_tabs(tabs);
   printf("}\n");
 }
 
-static void debug_if_block(IfBlock* block, int tabs)
+static void debug_if_block(Ast* ast, NodeIndex condition, NodeIndex body, int tabs)
 {
   printf("(");
-  debug_node(block->condition, 0);
+  debug_node(ast, condition, 0);
   printf(")\n");
-  debug_node(block->body, tabs + 1);
+  debug_node(ast, body, tabs + 1);
 }
 
-void debug_node(AstNode* node, int tabs)
+static void debug_fields(Ast* ast, u32 list, int tabs)
 {
+  for (u32 i = 0; i < list_count(ast, list); i++)
+  {
+    NodeIndex field = list_items(ast, list)[i];
+    print_tabs(tabs + 1);
+    debug_data_type(ast, ast->types[ast->data[field].lhs]);
+    printf(" ");
+    debug_token_literal(ast, field);
+    printf(";\n");
+  }
+}
+
+void debug_node(Ast* ast, NodeIndex node, int tabs)
+{
+  TimeFunction;
   print_tabs(tabs);
   if (node == 0)
   {
     printf("DEBUG 0 NODE\n");
     return;
   }
-  switch (node->type)
+  NodeData data = ast->data[node];
+  switch (ast->kinds[node])
   {
   case NODE_DO:
   {
     printf("do\n");
-    debug_node(node->do_.body, tabs);
+    debug_node(ast, data.rhs, tabs);
     print_tabs(tabs);
     printf("while(");
-    debug_node(node->do_.condition, 0);
+    debug_node(ast, data.lhs, 0);
     printf(");\n");
     break;
   }
   case NODE_ENUM:
   {
-    EnumNode* enum_node = &node->enum_;
     printf("enum {\n");
-    EnumValue* value = enum_node->values;
-    while (value != NULL)
+    u32 count = list_count(ast, data.lhs);
+    for (u32 i = 0; i < count; i++)
     {
+      NodeIndex value = list_items(ast, data.lhs)[i];
       print_tabs(tabs + 1);
-      printf("%.*s", (i32)value->name->len, value->name->buffer);
-      if (value->constant != 0)
+      debug_token_literal(ast, value);
+      if (ast->data[value].lhs != 0)
       {
-
         printf(" = ");
-        debug_token(value->constant);
+        debug_token_literal(ast, ast->data[value].lhs);
       }
-      if (value->next)
+      if (i + 1 < count)
       {
         printf(",");
       }
       printf("\n");
-
-      value = value->next;
     }
     printf("};\n");
     break;
@@ -178,36 +292,30 @@ void debug_node(AstNode* node, int tabs)
   }
   case NODE_BLOCK:
   {
-    debug_block(node->block.nodes, tabs);
+    debug_block(ast, data.lhs, tabs);
     break;
   }
   case NODE_FUNCTION:
   {
-    FunctionNode* func = &node->function;
-    debug_data_type(func->return_type);
-    printf(" %.*s(", (i32)func->name->len, func->name->buffer);
-    for (int i = 0; i < func->argument_count; i++)
+    u32 parameters = data.rhs + 1;
+    debug_data_type(ast, ast->types[data.lhs]);
+    printf(" ");
+    debug_token_literal(ast, node);
+    printf("(");
+    for (u32 i = 1; i < list_count(ast, parameters); i++)
     {
-      debug_argument(func->arguments[i]);
-      if (i < func->argument_count - 1)
-      {
-        printf(", ");
-      }
+      printf(", ");
     }
     printf(")");
-    debug_node(node->function.block, tabs);
+    debug_node(ast, ast->extra[data.rhs], tabs);
     break;
   }
-  case NODE_ARRAY:
-  {
-  }
   case NODE_ASSIGN:
   {
-    AssignNode* assign = &node->assign;
-    debug_node(assign->target, 0);
+    debug_node(ast, data.lhs, 0);
     printf(" = ");
-    debug_node(assign->value, 0);
-    if (assign->value->type != NODE_ASSIGN)
+    debug_node(ast, data.rhs, 0);
+    if (ast->kinds[data.rhs] != NODE_ASSIGN)
     {
       printf(";\n");
     }
@@ -215,130 +323,120 @@ void debug_node(AstNode* node, int tabs)
   }
   case NODE_FOR:
   {
-    ForNode* for_node = &node->for_;
+    u32* clauses = &ast->extra[data.lhs];
     printf("for(");
-    if (for_node->init)
+    if (clauses[0])
     {
-      debug_node(for_node->init, 0);
+      debug_node(ast, clauses[0], 0);
     }
     printf(";");
-    if (for_node->condition)
+    if (clauses[1])
     {
       printf(" ");
-      debug_node(for_node->condition, 0);
+      debug_node(ast, clauses[1], 0);
     }
     printf(";");
-    if (for_node->update)
+    if (clauses[2])
     {
       printf(" ");
-      debug_node(for_node->update, 0);
+      debug_node(ast, clauses[2], 0);
     }
     printf(")\n");
-    debug_node(for_node->body, tabs);
+    debug_node(ast, clauses[3], tabs);
     break;
   }
   case NODE_WHILE:
   {
     printf("while(");
-    debug_node(node->do_.condition, 0);
+    debug_node(ast, data.lhs, 0);
     printf(")");
-    debug_node(node->do_.body, tabs);
+    debug_node(ast, data.rhs, tabs);
     break;
   }
   case NODE_IF:
   {
-    IfNode* if_node = &node->if_;
+    u32* blocks = list_items(ast, data.lhs);
     printf("if");
-    debug_if_block(if_node->blocks, tabs);
-
-    IfBlock* block = if_node->blocks->next;
-    while (block)
+    debug_if_block(ast, blocks[0], blocks[1], tabs);
+    for (u32 i = 2; i < list_count(ast, data.lhs); i += 2)
     {
       printf("else if");
-      debug_if_block(block, tabs);
-      block = block->next;
+      debug_if_block(ast, blocks[i], blocks[i + 1], tabs);
     }
 
-    if (if_node->else_)
+    if (data.rhs)
     {
-      debug_node(if_node->else_, tabs);
+      debug_node(ast, data.rhs, tabs);
     }
-        break;
+    break;
   }
   case NODE_RETURN:
   {
     printf("return ");
-    debug_node(node->return_.value, tabs);
+    debug_node(ast, data.lhs, tabs);
     printf(";\n");
     break;
   }
   case NODE_VARIABLE:
   {
-    String literal = *node->variable.name;
-    printf("%.*s", (i32)literal.len, literal.buffer);
-    if (node->variable.value != NULL)
+    debug_token_literal(ast, node);
+    if (data.lhs != 0)
     {
       printf(" = ");
-      debug_node(node->variable.value, 0);
+      debug_node(ast, data.lhs, 0);
     }
     break;
   }
   case NODE_DECLARATION:
   {
-    debug_declaration(node->declaration);
-    if (node->declaration.variables)
+    u32 variables = data.rhs + 1;
+    debug_specifiers(ast->extra[data.rhs]);
+    debug_data_type(ast, ast->types[data.lhs]);
+    for (u32 i = 0; i < list_count(ast, variables); i++)
     {
-      AstNode* down = node->declaration.variables;
-      debug_node(down, 0);
-      printf(";\n");
-      break;
+      debug_node(ast, list_items(ast, variables)[i], 0);
     }
+    printf(";\n");
+    break;
   }
   case NODE_UNION:
   {
-    UnionNode* strukt = &node->union_;
-    printf("union %.*s {\n", (i32)strukt->name->len, strukt->name->buffer);
-    StructField* field = strukt->fields;
-    while (field)
-    {
-      print_tabs(tabs + 1);
-      debug_data_type(field->type);
-      printf(" %.*s;", (i32)field->name->len, field->name->buffer);
-      field = field->next;
-
-      printf("\n");
-    }
+    printf("union ");
+    debug_token_literal(ast, node);
+    printf(" {\n");
+    debug_fields(ast, data.lhs, tabs);
     printf("};\n");
     break;
   }
-  case NODE_STRUCT:
+  case NODE_TYPEDEF:
   {
-    StructNode* strukt = &node->struct_;
-    printf("struct %.*s {\n", (i32)strukt->name->len, strukt->name->buffer);
-    StructField* field = strukt->fields;
-    while (field)
+    if (data.rhs != 0)
     {
-      print_tabs(tabs + 1);
-      debug_data_type(field->type);
-      printf(" %.*s;", (i32)field->name->len, field->name->buffer);
-      field = field->next;
-
-      printf("\n");
+      debug_node(ast, data.rhs, 0);
+      print_tabs(tabs);
     }
-    printf("};\n");
+    printf("typedef ");
+    debug_data_type(ast, ast->types[data.lhs]);
+    printf(" ");
+    debug_token_literal(ast, node);
+    printf(";\n");
     break;
   }
-  case NODE_DEFINE:
-  {
-  }
-  case NODE_INCLUDE:
+  case NODE_STRUCT:
   {
+    printf("struct ");
+    debug_token_literal(ast, node);
+    printf(" {\n");
+    debug_fields(ast, data.lhs, tabs);
+    printf("};\n");
+    break;
   }
   case NODE_BINARY:
   {
+    TokenType op = ast->tokens[node].type;
     printf("(");
-    debug_node(node->binary.left, 0);
-    switch (node->binary.op)
+    debug_node(ast, data.lhs, 0);
+    switch (op)
     {
     case TOKEN_PLUS:
     {
@@ -362,26 +460,20 @@ void debug_node(AstNode* node, int tabs)
     }
     default:
     {
-      printf("Unknown token %s\n", get_token_type_string(node->binary.op));
+      printf("Unknown token %s\n", get_token_type_string(op));
       exit(1);
     }
     }
-    debug_node(node->binary.right, 0);
+    debug_node(ast, data.rhs, 0);
     printf(")");
     break;
   }
-  case NODE_CALL:
-  {
-  }
-  case NODE_CAST:
-  {
-  }
   case NODE_COMPARISON:
   {
-
+    TokenType op = ast->tokens[node].type;
     printf("(");
-    debug_node(node->comparison.left, 0);
-    switch (node->comparison.op)
+    debug_node(ast, data.lhs, 0);
+    switch (op)
     {
     case TOKEN_LESS:
     {
@@ -415,58 +507,51 @@ void debug_node(AstNode* node, int tabs)
     }
     default:
     {
-      printf("Unknown token %s\n", get_token_type_string(node->binary.op));
+      printf("Unknown token %s\n", get_token_type_string(op));
       exit(1);
     }
     }
-    debug_node(node->comparison.right, 0);
+    debug_node(ast, data.rhs, 0);
     printf(")");
     break;
   }
-  case NODE_DOT:
-  {
-  }
-  case NODE_GROUPED:
-  {
-  }
-  case NODE_INDEX:
-  {
-  }
   case NODE_CONSTANT:
+  case NODE_IDENTIFIER:
   {
-    String literal = node->constant.token->literal;
-    printf("%.*s", (i32)literal.len, literal.buffer);
+    debug_token_literal(ast, node);
     break;
   }
-  case NODE_LOGICAL:
-  {
-  }
   case NODE_POSTFIX:
   {
-    PostfixNode* postfix = &node->postfix;
-    debug_node(postfix->node, 0);
-    debug_token(postfix->postfix);
+    debug_node(ast, data.lhs, 0);
+    printf(ast->tokens[node].type == TOKEN_INCREMENT ? "++" : "--");
     break;
   }
+  // printed by their parent or not parsed yet
+  case NODE_PARAMETER:
+  case NODE_FIELD:
+  case NODE_ENUM_VALUE:
+  case NODE_SWITCH:
+  case NODE_ARRAY:
+  case NODE_DEFINE:
+  case NODE_INCLUDE:
+  case NODE_CALL:
+  case NODE_CAST:
+  case NODE_DOT:
+  case NODE_GROUPED:
+  case NODE_INDEX:
+  case NODE_LOGICAL:
   case NODE_UNARY:
-  {
-  }
   case NODE_BREAK:
-  {
-  }
   case NODE_CONTINUE:
-  {
-  }
-  case NODE_IDENTIFIER:
-  {
-  }
   case NODE_GOTO:
   {
+    break;
   }
   }
+}
 
-  if (node->next)
-  {
-    debug_node(node->next, tabs);
-  }
+void debug_ast(Ast* ast)
+{
+  debug_list(ast, ast->root, 0);
 }
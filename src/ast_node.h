@@ -1,11 +1,14 @@
 #ifndef AST_NODE_H
 #define AST_NODE_H
 
+#include "common.h"
+#include "scanner.h"
 #include "token.h"
 
 typedef enum
 {
   NODE_FUNCTION,
+  NODE_PARAMETER,
   NODE_ARRAY,
   NODE_ASSIGN,
   NODE_DO,
@@ -18,7 +21,10 @@ typedef enum
   NODE_DECLARATION,
   NODE_STRUCT,
   NODE_UNION,
+  NODE_FIELD,
   NODE_ENUM,
+  NODE_ENUM_VALUE,
+  NODE_TYPEDEF,
   NODE_DEFINE,
   NODE_INCLUDE,
   NODE_BINARY,
@@ -41,11 +47,6 @@ typedef enum
 
 } AstNodeType;
 
-typedef struct
-{
-  Token* token;
-} ConstantNode;
-
 typedef enum
 {
   DATA_TYPE_INTEGER,
@@ -67,7 +68,7 @@ typedef struct
 
 typedef struct
 {
-  Token* token; // name
+  u32 symbol; // name of the struct, union, enum or typedef
 } DataTypeStruct;
 
 typedef struct
@@ -85,163 +86,89 @@ typedef struct
     DataTypeInteger  integer;
     DataTypeFloat    floating_point;
     DataTypeFunction function;
+    DataTypeStruct   strukt;
   };
   int depth;
 } DataType;
 
-typedef struct
-{
-  String*  name;
-  DataType type;
-} Argument;
-
-typedef struct AstNode AstNode;
-
-typedef struct
-{
-  AstNode* nodes;
-} BlockNode;
-
-typedef struct
-{
-  DataType  return_type;
-  String*   name;
-  Argument* arguments;
-  int       argument_count;
-  AstNode*  block;
-} FunctionNode;
-
-typedef struct
-{
-  AstNode* init;
-  AstNode* condition;
-  AstNode* update;
-  AstNode* body;
-} ForNode;
-
-typedef struct
-{
-  AstNode* condition;
-  AstNode* body;
-} WhileNode;
-
-typedef WhileNode DoNode;
-typedef struct
-{
-  TokenType op;
-  AstNode*  left;
-  AstNode*  right;
-} BinaryNode;
-
-typedef BinaryNode ComparisonNode;
-
-typedef struct
-{
-  String*  name;
-  AstNode* value;
-} VariableNode;
-
-typedef struct
-{
-  DataType type;
-  char     type_qualifier;
-  char     storage_specifier;
-  AstNode* variables;
-} DeclarationNode;
-
-typedef struct
-{
-  AstNode* target;
-  AstNode* value;
-} AssignNode;
-
-typedef struct
-{
-  AstNode* value;
-} ReturnNode;
-
-typedef struct EnumValue EnumValue;
-
-struct EnumValue
-{
-  String*    name;
-  Token*     constant;
-  EnumValue* next;
-};
-
-typedef struct
-{
-  EnumValue* values;
-  String*    name;
-} EnumNode;
-
-typedef struct
-{
-  AstNode* node;
-  Token*   postfix;
-} PostfixNode;
-
-typedef struct StructField StructField;
-struct StructField
-{
-  DataType     type;
-  String*      name;
-  StructField* next;
-};
-
-typedef struct
-{
-  StructField* fields;
-  String*      name;
-} StructNode;
-typedef StructNode    UnionNode;
-
-typedef struct IfBlock IfBlock;
-struct IfBlock{
-  AstNode * condition;
-  AstNode * body;
-  IfBlock * next;
-};
-
-typedef struct IfNode IfNode;
-struct IfNode
-{
-  IfBlock*  blocks;
-  AstNode* else_;
-};
-
-typedef struct {
-  AstNode * condition;
-  AstNode * block;
-} SwitchNode;
-
-struct AstNode
-{
-  AstNodeType type;
-  AstNode*    next;
-  union
-  {
-    IfNode          if_;
-    ConstantNode    constant;
-    FunctionNode    function;
-    BinaryNode      binary;
-    ComparisonNode  comparison;
-    DeclarationNode declaration;
-    VariableNode    variable;
-    ReturnNode      return_;
-    BlockNode       block;
-    WhileNode       while_;
-    ForNode         for_;
-    AssignNode      assign;
-    EnumNode        enum_;
-    DoNode          do_;
-    PostfixNode     postfix;
-    StructNode      struct_;
-    UnionNode       union_;
-    SwitchNode switch_;
-  };
-};
-
-void debug_node(AstNode* node, int tabs);
+/*
+  The tree lives in parallel arrays indexed by NodeIndex, the same way the
+  token buffer does. Every node is a one byte kind, the token it was made
+  from and two u32 whose meaning depends on the kind. Children are node
+  indices, types index the types table and what doesn't fit in two words
+  goes to extra with the node holding where it starts. A list is a count
+  followed by that many entries in extra, so the children of a block are
+  next to each other instead of linked through the nodes.
+
+    kind              token       lhs                   rhs
+    CONSTANT          constant    -                     -
+    IDENTIFIER        name        -                     -
+    BINARY            operator    left                  right
+    COMPARISON        operator    left                  right
+    POSTFIX           operator    operand               -
+    ASSIGN            =           target                value
+    DECLARATION       -           type                  extra: specifiers, list of VARIABLE
+    VARIABLE          name        value or 0            -
+    FUNCTION          name        return type           extra: body or 0, list of PARAMETER
+    PARAMETER         name        type                  -
+    BLOCK             {           list of statements    -
+    IF                if          list of condition and body pairs   else or 0
+    WHILE, DO         keyword     condition             body
+    FOR               for         extra: init, condition, update and body, 0 when left out
+    SWITCH            switch      condition             body
+    RETURN            return      value                 -
+    STRUCT, UNION     name        list of FIELD         -
+    FIELD             name        type                  -
+    ENUM              name        list of ENUM_VALUE    -
+    ENUM_VALUE        name        CONSTANT, IDENTIFIER or 0
+    TYPEDEF           name        type                  STRUCT, UNION or ENUM defined with it or 0
+    EMPTY             ;           -                     -
+
+  Specifiers are the type qualifiers with the storage specifier shifted
+  up by 8. Index 0 is no node, the first slot is never used.
+*/
+typedef u32 NodeIndex;
+
+typedef struct
+{
+  u32 lhs;
+  u32 rhs;
+} NodeData;
+
+typedef struct
+{
+  Arena*    arena;
+  Scanner*  scanner; // what the tokens' values index
+  u8*       kinds;
+  Token*    tokens;
+  NodeData* data;
+  u32       count;
+  u32       capacity;
+  u32*      extra;
+  u32       extra_count;
+  u32       extra_capacity;
+  DataType* types;
+  u32       type_count;
+  u32       type_capacity;
+  u32       root; // list of the top level declarations
+} Ast;
+
+void      init_ast(Ast* ast, Arena* arena, Scanner* scanner, u32 capacity);
+NodeIndex push_node(Ast* ast, AstNodeType kind, Token token, u32 lhs, u32 rhs);
+u32       push_extra(Ast* ast, u32 value);
+u32       push_type(Ast* ast, DataType type);
+
+static inline u32 list_count(Ast* ast, u32 list)
+{
+  return ast->extra[list];
+}
+
+static inline u32* list_items(Ast* ast, u32 list)
+{
+  return &ast->extra[list + 1];
+}
+
+void debug_node(Ast* ast, NodeIndex node, int tabs);
+void debug_ast(Ast* ast);
 
 #endif
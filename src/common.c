@@ -1,9 +1,19 @@
+// MAP_ANONYMOUS and MAP_NORESERVE are outside of c11
+#define _DEFAULT_SOURCE
 #include "common.h"
+#include <cpuid.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 #include <x86intrin.h>
 
 /*
@@ -14,21 +24,128 @@
  =========================================
 */
 
+// the pages up to end are made usable, in whole steps
+static void sta_arena_commit(Arena *arena, u64 end) {
+  u64 committed = (end + ARENA_COMMIT_STEP - 1) / ARENA_COMMIT_STEP * ARENA_COMMIT_STEP;
+  committed = MIN(committed, arena->maxSize);
+  if (mprotect((void *)(arena->memory + arena->committed),
+               committed - arena->committed, PROT_READ | PROT_WRITE) != 0) {
+    printf("Failed to commit arena memory! %ld\n", committed);
+    exit(1);
+  }
+  arena->committed = committed;
+}
+
 u64 sta_arena_push(Arena *arena, u64 size) {
-  if (arena->ptr + size > arena->maxSize) {
-    printf("Over max size! %ld %ld %ld\n", size, arena->ptr, arena->maxSize);
-    return 0;
+  u64 start = (arena->ptr + ARENA_ALIGNMENT - 1) & ~(u64)(ARENA_ALIGNMENT - 1);
+  u64 end = start + size;
+  if (end > arena->committed) {
+    if (!arena->reserved || end > arena->maxSize) {
+      printf("Over max size! %ld %ld %ld\n", size, arena->ptr, arena->maxSize);
+      exit(1);
+    }
+    sta_arena_commit(arena, end);
+  }
+  arena->ptr = end;
+  arena->highWater = MAX(arena->highWater, end);
+  return arena->memory + start;
+}
+u64 sta_arena_push_tagged(Arena *arena, u64 size, const char *tag) {
+#if PROFILER
+  if (profileAllocations) {
+    profileAllocation(tag, size);
   }
-  u64 out = arena->memory + arena->ptr;
-  arena->ptr += size;
-  return out;
+#endif
+  return sta_arena_push(arena, size);
 }
 void sta_arena_pop(Arena *arena, u64 size) { arena->ptr -= size; }
 void sta_arena_init_heap(Arena *arena, u64 size) {
   arena->ptr = 0;
   arena->maxSize = size;
+  arena->committed = size;
+  arena->highWater = 0;
+  arena->reserved = false;
+  arena->hugePages = false;
   arena->memory = (u64)malloc(size);
 }
+// PROT_NONE with no swap reserved, nothing is backed until committed
+static void *sta_arena_reserve(u64 size) {
+  void *memory = mmap(0, size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (memory == MAP_FAILED) {
+    printf("Failed to reserve arena memory! %ld\n", size);
+    exit(1);
+  }
+  return memory;
+}
+void sta_arena_init_virtual(Arena *arena, u64 size) {
+  arena->ptr = 0;
+  arena->maxSize = size;
+  arena->committed = 0;
+  arena->highWater = 0;
+  arena->reserved = true;
+  arena->hugePages = false;
+  arena->memory = (u64)sta_arena_reserve(size);
+}
+/*
+  THP only backs 2MB aligned ranges, so one huge page more is reserved and
+  the unaligned ends are given back. MAP_HUGETLB isn't used, its pages come
+  from a pool that has to be set up and a fault with the pool empty is a
+  SIGBUS, where THP just falls back to normal pages.
+*/
+void sta_arena_init_huge(Arena *arena, u64 size) {
+  size = (size + ARENA_HUGE_PAGE_SIZE - 1) & ~(ARENA_HUGE_PAGE_SIZE - 1);
+  u64 memory = (u64)sta_arena_reserve(size + ARENA_HUGE_PAGE_SIZE);
+  u64 aligned = (memory + ARENA_HUGE_PAGE_SIZE - 1) & ~(ARENA_HUGE_PAGE_SIZE - 1);
+  if (aligned > memory) {
+    munmap((void *)memory, aligned - memory);
+  }
+  munmap((void *)(aligned + size), memory + ARENA_HUGE_PAGE_SIZE - aligned);
+
+  arena->ptr = 0;
+  arena->maxSize = size;
+  arena->committed = 0;
+  arena->highWater = 0;
+  arena->reserved = true;
+  arena->memory = aligned;
+  // the advice sticks to the range, pages committed later get it too
+  arena->hugePages = madvise((void *)aligned, size, MADV_HUGEPAGE) == 0;
+}
+void sta_arena_free(Arena *arena) {
+  if (arena->reserved) {
+    munmap((void *)arena->memory, arena->maxSize);
+  } else {
+    free((void *)arena->memory);
+  }
+  arena->memory = 0;
+}
+ArenaMarker sta_arena_save(Arena *arena) {
+  return (ArenaMarker){.arena = arena, .ptr = arena->ptr};
+}
+void sta_arena_restore(ArenaMarker marker) { marker.arena->ptr = marker.ptr; }
+
+static _Thread_local Arena scratch_arenas[2];
+
+ArenaMarker sta_get_scratch(Arena *conflict) {
+  Arena *scratch = &scratch_arenas[conflict == &scratch_arenas[0]];
+  if (scratch->memory == 0) {
+    sta_arena_init_virtual(scratch, ARENA_RESERVE_SIZE);
+  }
+  return sta_arena_save(scratch);
+}
+void sta_scratch_free(void) {
+  for (u32 i = 0; i < ArrayCount(scratch_arenas); i++) {
+    if (scratch_arenas[i].memory != 0) {
+      sta_arena_free(&scratch_arenas[i]);
+    }
+  }
+}
+void sta_arena_report(Arena *arena, const char *name) {
+  printf("%s arena: %.2f MB used at most, %.2f MB committed%s\n", name,
+         arena->highWater / (1024.0 * 1024.0),
+         arena->committed / (1024.0 * 1024.0),
+         arena->hugePages ? " on huge pages" : "");
+}
 
 /*
  =========================================
@@ -39,38 +156,399 @@ void sta_arena_init_heap(Arena *arena, u64 size) {
 */
 
 Profiler profiler;
-u32 globalProfilerParentIndex = 0;
-ProfileAnchor globalProfileAnchors[4096];
+
+static u64 GetOSTimerFreq(void) { return 1000000000; }
+
+// nanoseconds, unlike CLOCK_MONOTONIC the raw clock isn't slewed by ntp
+static u64 ReadOSTimer(void) {
+  struct timespec Value;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &Value);
+
+  u64 Result = GetOSTimerFreq() * (u64)Value.tv_sec + (u64)Value.tv_nsec;
+  return Result;
+}
+
+u64 ReadCPUTimer(void) { return __rdtsc(); }
+
+// an invariant TSC ticks at the same rate whatever clock the core runs at,
+// otherwise cycles can't be turned into time
+bool CPUTimerIsInvariant(void) {
+  u32 eax, ebx, ecx, edx;
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8));
+}
+
+// leaf 0x15 is the ratio of the TSC to the crystal clock and, not on every
+// cpu, the crystal's frequency. 0 when it isn't there
+static u64 ReadCPUTimerFreqFromCPUID(void) {
+  if (!CPUTimerIsInvariant() || __get_cpuid_max(0, 0) < 0x15) {
+    return 0;
+  }
+  u32 denominator, numerator, crystal, edx;
+  __cpuid_count(0x15, 0, denominator, numerator, crystal, edx);
+  if (!denominator || !numerator || !crystal) {
+    return 0;
+  }
+  return (u64)crystal * numerator / denominator;
+}
+
+#define CALIBRATION_MS 5
+
+// the os timer is read between two reads of the TSC and taken to be in
+// the middle, which keeps the error at the ends to a few cycles
+static u64 CalibrateCPUTimerFreq(void) {
+  u64 OSFreq = GetOSTimerFreq();
+
+  u64 CPUBefore = ReadCPUTimer();
+  u64 OSStart = ReadOSTimer();
+  u64 CPUStart = CPUBefore + (ReadCPUTimer() - CPUBefore) / 2;
+  u64 OSElapsed = 0;
+  u64 OSEnd = 0;
+  u64 OSWaitTime = OSFreq * CALIBRATION_MS / 1000;
+  while (OSElapsed < OSWaitTime) {
+    CPUBefore = ReadCPUTimer();
+    OSEnd = ReadOSTimer();
+    OSElapsed = OSEnd - OSStart;
+  }
+
+  u64 CPUEnd = CPUBefore + (ReadCPUTimer() - CPUBefore) / 2;
+  u64 CPUElapsed = CPUEnd - CPUStart;
+
+  return OSFreq * CPUElapsed / OSElapsed;
+}
+#undef CALIBRATION_MS
+
+static _Atomic u64 cpuTimerFreq;
+
+// worked out once per process, from cpuid when it says or by timing the
+// TSC against the os timer for a few milliseconds
+u64 EstimateCPUTimerFreq(void) {
+  u64 freq = atomic_load_explicit(&cpuTimerFreq, memory_order_relaxed);
+  if (!freq) {
+    freq = ReadCPUTimerFreqFromCPUID();
+    if (!freq) {
+      freq = CalibrateCPUTimerFreq();
+    }
+    atomic_store_explicit(&cpuTimerFreq, freq, memory_order_relaxed);
+  }
+  return freq;
+}
+
+u64 CPUTimerToNanoseconds(u64 ticks) {
+  return (unsigned __int128)ticks * 1000000000 / EstimateCPUTimerFreq();
+}
+
+#if PROFILER
+
+bool profilerRunning;
+
+static _Thread_local ProfileThread *profileThread;
+static ProfileThread *profileThreads;
+static u32 profileThreadCount;
+static pthread_mutex_t profileThreadLock = PTHREAD_MUTEX_INITIALIZER;
+// 0 is the root every top level block is a child of
+static _Atomic u32 profileAnchorCount = 1;
+
+u32 getProfileAnchor(_Atomic u32 *anchor) {
+  u32 index = atomic_load_explicit(anchor, memory_order_relaxed);
+  if (index == 0) {
+    // two threads racing here both get one, the loser's stays unused
+    u32 fresh = atomic_fetch_add(&profileAnchorCount, 1);
+    if (fresh >= PROFILER_MAX_ANCHORS) {
+      printf("Too many profile blocks! %u\n", fresh);
+      exit(1);
+    }
+    index = atomic_compare_exchange_strong(anchor, &index, fresh) ? fresh
+                                                                  : index;
+  }
+  return index;
+}
+
+/*
+  The counters of a thread are one perf event group, so they are scheduled
+  together and read with a single read(). Whether they count at all is up
+  to the kernel, see perf_event_paranoid, without them the group is -1 and
+  only time is profiled. Opening and reading them costs syscalls, so
+  threads only get a group after initProfileCounters. When the kernel
+  multiplexes the group the totals are scaled up by the share of time it
+  ran, like perf stat does. Blocks keep the raw counts, a difference of
+  two scaled reads could go negative, and the output says they're low.
+*/
+static bool profileBlockCounters;
+static _Atomic bool profileCountersScaled;
+
+static i32 openCounter(u32 type, u64 config, i32 group) {
+  struct perf_event_attr attr = {};
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+// the leader is fds[0], -1 when the group couldn't be opened
+static void openCounterGroup(i32 *fds) {
+  static const struct {
+    u32 type;
+    u64 config;
+  } events[PROFILE_COUNTER_COUNT] = {
+      [PROFILE_COUNTER_CYCLES] = {PERF_TYPE_HARDWARE,
+                                  PERF_COUNT_HW_CPU_CYCLES},
+      [PROFILE_COUNTER_INSTRUCTIONS] = {PERF_TYPE_HARDWARE,
+                                        PERF_COUNT_HW_INSTRUCTIONS},
+      [PROFILE_COUNTER_BRANCH_MISSES] = {PERF_TYPE_HARDWARE,
+                                         PERF_COUNT_HW_BRANCH_MISSES},
+      [PROFILE_COUNTER_CACHE_MISSES] = {PERF_TYPE_HARDWARE,
+                                        PERF_COUNT_HW_CACHE_MISSES},
+      [PROFILE_COUNTER_DTLB_MISSES] =
+          {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  };
+  for (u32 i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+    fds[i] = openCounter(events[i].type, events[i].config, i ? fds[0] : -1);
+    if (fds[i] < 0) {
+      for (u32 j = 0; j < i; j++) {
+        close(fds[j]);
+      }
+      fds[0] = -1;
+      return;
+    }
+  }
+}
+
+// the members are only ever read through the leader, but each is an fd
+static void closeCounterGroup(i32 *fds) {
+  if (fds[0] < 0) {
+    return;
+  }
+  for (u32 i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+    close(fds[i]);
+  }
+  fds[0] = -1;
+}
+
+// false when the group couldn't be read or never got on the PMU, which
+// happens when it asks for more counters than the CPU has. scale is
+// enabled over running time, 1 when the group was never descheduled
+static bool readCounterGroup(i32 group, u64 *counters, f64 *scale) {
+  struct {
+    u64 count;
+    u64 timeEnabled;
+    u64 timeRunning;
+    u64 values[PROFILE_COUNTER_COUNT];
+  } result;
+  if (group < 0 || read(group, &result, sizeof(result)) != sizeof(result) ||
+      result.timeRunning == 0) {
+    memset(counters, 0, sizeof(u64) * PROFILE_COUNTER_COUNT);
+    return false;
+  }
+  memcpy(counters, result.values, sizeof(result.values));
+  if (result.timeRunning < result.timeEnabled) {
+    atomic_store_explicit(&profileCountersScaled, true, memory_order_relaxed);
+  }
+  if (scale) {
+    *scale = result.timeEnabled / (f64)result.timeRunning;
+  }
+  return true;
+}
+
+// made on the first block a thread enters and never freed, the results
+// have to outlive the thread
+static ProfileThread *getProfileThread(void) {
+  if (!profileThread) {
+    profileThread = calloc(1, sizeof(ProfileThread));
+    profileThread->counterFds[0] = -1;
+    if (profileBlockCounters) {
+      openCounterGroup(profileThread->counterFds);
+    }
+    pthread_mutex_lock(&profileThreadLock);
+    profileThread->id = profileThreadCount++;
+    profileThread->next = profileThreads;
+    profileThreads = profileThread;
+    pthread_mutex_unlock(&profileThreadLock);
+  }
+  return profileThread;
+}
+
+/*
+  With tracing on, every block entered and left is also an event in one
+  buffer shared by all threads, written out as Chrome Trace Event JSON for
+  Perfetto or chrome://tracing. The buffer is allocated up front and never
+  wraps. Entering a block reserves the slots of both its events, so a
+  block either gets its 'B' and its 'E' or is dropped whole and counted,
+  and the spans always balance. Tracing never allocates or blocks.
+*/
+typedef struct {
+  u64 time;
+  u64 byteCount;
+  char const *label;
+  u32 thread;
+  char phase; // 'B' or 'E'
+} TraceEvent;
+
+#define TRACE_NO_SLOT UINT32_MAX
+
+static TraceEvent *traceEvents;
+static u32 traceCapacity;
+static _Atomic u32 traceCount; // never past traceCapacity
+static _Atomic u64 traceDropped;
+
+void initProfileTrace(u32 maxEvents) {
+  traceEvents = malloc(sizeof(TraceEvent) * maxEvents);
+  traceCapacity = maxEvents;
+  atomic_store(&traceCount, 0);
+  atomic_store(&traceDropped, 0);
+}
+
+// both events of a block or none, the count only moves while both fit
+static u32 reserveTracePair(void) {
+  u32 index = atomic_load_explicit(&traceCount, memory_order_relaxed);
+  do {
+    if (traceCapacity - index < 2) {
+      atomic_fetch_add_explicit(&traceDropped, 2, memory_order_relaxed);
+      return TRACE_NO_SLOT;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+      &traceCount, &index, index + 2, memory_order_relaxed,
+      memory_order_relaxed));
+  return index;
+}
+
+static void writeTraceEvent(u32 slot, ProfileThread *thread,
+                            char const *label, u64 time, u64 byteCount,
+                            char phase) {
+  traceEvents[slot] = (TraceEvent){.time = time,
+                                   .byteCount = byteCount,
+                                   .label = label,
+                                   .thread = thread->id,
+                                   .phase = phase};
+}
+
+bool writeProfileTrace(const char *fileName) {
+  FILE *filePtr = fopen(fileName, "w");
+  if (!filePtr) {
+    return false;
+  }
+  u32 count = atomic_load(&traceCount);
+  u64 dropped = atomic_load(&traceDropped);
+  u32 open = 0;
+
+  // viewers order the events by time, a pair is written together
+  fprintf(filePtr, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  bool first = true;
+  for (u32 i = 0; i + 1 < count; i += 2) {
+    // still inside the block, it has no end to write
+    if (!traceEvents[i + 1].label) {
+      open++;
+      continue;
+    }
+    for (u32 j = i; j < i + 2; j++) {
+      TraceEvent *event = &traceEvents[j];
+      // microseconds since initProfiler
+      f64 time = CPUTimerToNanoseconds(event->time - profiler.StartTSC) / 1e3;
+      fprintf(filePtr,
+              "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+              "\"tid\":%u",
+              first ? "" : ",", event->label, event->phase, time,
+              event->thread);
+      if (event->phase == 'B') {
+        fprintf(filePtr, ",\"args\":{\"bytes\":%lu}", event->byteCount);
+      }
+      fprintf(filePtr, "}");
+      first = false;
+    }
+  }
+  fprintf(filePtr, "\n]}\n");
+  if (dropped) {
+    printf("Trace full, dropped %lu of %lu events\n", dropped,
+           dropped + count);
+  }
+  if (open) {
+    printf("Left out %u blocks still open when the trace was written\n",
+           open);
+  }
+
+  free(traceEvents);
+  traceEvents = 0;
+  return fclose(filePtr) == 0;
+}
 
 void initProfileBlock(ProfileBlock *block, char const *label_, u32 index_,
                       u64 byteCount) {
-  block->parentIndex = globalProfilerParentIndex;
+  ProfileThread *thread = getProfileThread();
+  block->parentIndex = thread->parentIndex;
 
   block->index = index_;
   block->label = label_;
 
-  ProfileAnchor *profile = globalProfileAnchors + block->index;
+  ProfileAnchor *profile = thread->anchors + block->index;
   block->oldElapsedInclusive = profile->elapsedInclusive;
   profile->processedByteCount += byteCount;
 
-  globalProfilerParentIndex = block->index;
+  thread->parentIndex = block->index;
+  if (profileBlockCounters) {
+    readCounterGroup(thread->counterFds[0], block->startCounters, 0);
+  }
+  block->traceSlot = traceEvents ? reserveTracePair() : TRACE_NO_SLOT;
   block->startTime = ReadCPUTimer();
+  if (block->traceSlot != TRACE_NO_SLOT) {
+    writeTraceEvent(block->traceSlot, thread, label_, block->startTime,
+                    byteCount, 'B');
+    // no label until the block is left
+    traceEvents[block->traceSlot + 1].label = 0;
+  }
 }
 void exitProfileBlock(ProfileBlock *block) {
-  u64 elapsed = ReadCPUTimer() - block->startTime;
-  globalProfilerParentIndex = block->parentIndex;
+  if (!block->label) {
+    return;
+  }
+  u64 end = ReadCPUTimer();
+  u64 elapsed = end - block->startTime;
+  ProfileThread *thread = profileThread;
+  u64 counters[PROFILE_COUNTER_COUNT] = {};
+  if (profileBlockCounters &&
+      readCounterGroup(thread->counterFds[0], counters, 0)) {
+    for (u32 i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+      counters[i] -= block->startCounters[i];
+    }
+  }
+  if (traceEvents && block->traceSlot != TRACE_NO_SLOT) {
+    writeTraceEvent(block->traceSlot + 1, thread, block->label, end, 0, 'E');
+  }
+  thread->parentIndex = block->parentIndex;
 
-  ProfileAnchor *parent = globalProfileAnchors + block->parentIndex;
-  ProfileAnchor *profile = globalProfileAnchors + block->index;
+  ProfileAnchor *parent = thread->anchors + block->parentIndex;
+  ProfileAnchor *profile = thread->anchors + block->index;
 
   parent->elapsedExclusive -= elapsed;
   profile->elapsedExclusive += elapsed;
   profile->elapsedInclusive = block->oldElapsedInclusive + elapsed;
   ++profile->hitCount;
+  for (u32 i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+    parent->counters[i] -= counters[i];
+    profile->counters[i] += counters[i];
+  }
 
   profile->label = block->label;
 }
 
+static void PrintCounters(u64 *counters) {
+  u64 instructions = counters[PROFILE_COUNTER_INSTRUCTIONS];
+  if (!instructions || !counters[PROFILE_COUNTER_CYCLES]) {
+    return;
+  }
+  // misses per thousand instructions
+  f64 kilo = instructions / 1000.0;
+  printf(" ipc %.2f, mpki branch %.3f cache %.3f dTLB %.3f",
+         instructions / (f64)counters[PROFILE_COUNTER_CYCLES],
+         counters[PROFILE_COUNTER_BRANCH_MISSES] / kilo,
+         counters[PROFILE_COUNTER_CACHE_MISSES] / kilo,
+         counters[PROFILE_COUNTER_DTLB_MISSES] / kilo);
+}
+
 static void PrintTimeElapsed(ProfileAnchor *Anchor, u64 timerFreq,
                              u64 TotalTSCElapsed) {
 
@@ -84,69 +562,206 @@ static void PrintTimeElapsed(ProfileAnchor *Anchor, u64 timerFreq,
   }
   if (Anchor->processedByteCount) {
     f64 mb = 1024.0f * 1024.0f;
-    f64 gb = mb * 1024.0f;
 
     f64 seconds = Anchor->elapsedInclusive / (f64)timerFreq;
     f64 bytesPerSecond = Anchor->processedByteCount / seconds;
     f64 mbProcessed = Anchor->processedByteCount / mb;
-    f64 gbProcessed = bytesPerSecond / gb;
 
-    printf(" %.3fmb at %.2fgb/s", mbProcessed, gbProcessed);
+    // phases run at tens to hundreds of mb/s, gb/s rounded them to nothing
+    printf(" %.3fmb at %.2fmb/s", mbProcessed, bytesPerSecond / mb);
   }
+  PrintCounters(Anchor->counters);
   printf(")\n");
 }
-static u64 GetOSTimerFreq(void) { return 1000000; }
-
-static u64 ReadOSTimer(void) {
-  struct timeval Value;
-  gettimeofday(&Value, 0);
-
-  u64 Result = GetOSTimerFreq() * (u64)Value.tv_sec + (u64)Value.tv_usec;
-  return Result;
+void initProfiler() {
+  // the calibration, if there is one, isn't part of what's profiled
+  EstimateCPUTimerFreq();
+  // opens the counters of this thread, they count from here on
+  getProfileThread();
+  profilerRunning = true;
+  profiler.StartTSC = ReadCPUTimer();
 }
 
-u64 ReadCPUTimer(void) { return __rdtsc(); }
+void initProfileCounters() { profileBlockCounters = true; }
 
-#define TIME_TO_WAIT 100
+/*
+  With allocations profiled every tagged push is counted against the block
+  it happens in and its tag. Scratch pushes count too, this is what was
+  pushed rather than what is still in use, the arenas' high water marks
+  are the peak.
+*/
+bool profileAllocations;
+
+void initProfileAllocations() { profileAllocations = true; }
+
+void profileAllocation(const char *tag, u64 size) {
+  ProfileThread *thread = getProfileThread();
+  ProfileAnchor *anchor = thread->anchors + thread->parentIndex;
+  anchor->allocatedBytes += size;
+  anchor->allocationCount++;
+
+  // literals don't move, the address is the key. The same tag from two
+  // files can be two entries, they're merged by name when displayed
+  u32 slot = ((u64)tag >> 3) & (PROFILER_MAX_ALLOCATION_TAGS - 1);
+  for (u32 probe = 0; probe < PROFILER_MAX_ALLOCATION_TAGS; probe++) {
+    ProfileAllocation *allocation = &thread->allocations[slot];
+    if (allocation->tag == tag || allocation->tag == 0) {
+      allocation->tag = tag;
+      allocation->bytes += size;
+      allocation->count++;
+      return;
+    }
+    slot = (slot + 1) & (PROFILER_MAX_ALLOCATION_TAGS - 1);
+  }
+  printf("Too many allocation tags! %s\n", tag);
+  exit(1);
+}
 
-u64 EstimateCPUTimerFreq(void) {
-  u64 OSFreq = GetOSTimerFreq();
+static i32 compareAllocations(const void *a, const void *b) {
+  u64 first = ((const ProfileAllocation *)a)->bytes;
+  u64 second = ((const ProfileAllocation *)b)->bytes;
+  return first < second ? 1 : first > second ? -1 : 0;
+}
 
-  u64 CPUStart = ReadCPUTimer();
-  u64 OSStart = ReadOSTimer();
-  u64 OSElapsed = 0;
-  u64 OSEnd = 0;
-  u64 OSWaitTime = OSFreq * TIME_TO_WAIT / 1000;
-  while (OSElapsed < OSWaitTime) {
-    OSEnd = ReadOSTimer();
-    OSElapsed = OSEnd - OSStart;
+static void printAllocations(ProfileAnchor *anchors) {
+  f64 mb = 1024.0 * 1024.0;
+  printf("Allocations by block:\n");
+  for (u32 i = 0; i < PROFILER_MAX_ANCHORS; i++) {
+    ProfileAnchor *anchor = anchors + i;
+    if (anchor->allocationCount) {
+      // a block still open has no label yet
+      char const *label = i == 0 ? "outside blocks" : anchor->label;
+      printf("  %s: %.3fmb in %lu pushes\n", label ? label : "open block",
+             anchor->allocatedBytes / mb, anchor->allocationCount);
+    }
   }
 
-  u64 CPUEnd = ReadCPUTimer();
-  u64 CPUElapsed = CPUEnd - CPUStart;
-
-  return OSFreq * CPUElapsed / OSElapsed;
+  static ProfileAllocation merged[PROFILER_MAX_ALLOCATION_TAGS];
+  u32 count = 0;
+  for (ProfileThread *thread = profileThreads; thread; thread = thread->next) {
+    for (u32 i = 0; i < PROFILER_MAX_ALLOCATION_TAGS; i++) {
+      ProfileAllocation *allocation = &thread->allocations[i];
+      if (!allocation->tag) {
+        continue;
+      }
+      u32 j = 0;
+      while (j < count && strcmp(merged[j].tag, allocation->tag) != 0) {
+        j++;
+      }
+      if (j == count) {
+        merged[count++] = (ProfileAllocation){.tag = allocation->tag};
+      }
+      merged[j].bytes += allocation->bytes;
+      merged[j].count += allocation->count;
+    }
+  }
+  qsort(merged, count, sizeof(ProfileAllocation), compareAllocations);
+  printf("Allocations by type:\n");
+  for (u32 i = 0; i < count; i++) {
+    printf("  %s: %.3fmb in %lu pushes\n", merged[i].tag, merged[i].bytes / mb,
+           merged[i].count);
+  }
 }
-#undef TIME_TO_WAIT
-
-void initProfiler() { profiler.StartTSC = ReadCPUTimer(); }
 
 void displayProfilingResult() {
   u64 endTime = ReadCPUTimer();
   u64 totalElapsed = endTime - profiler.StartTSC;
+  // every thread counted from its first block on, the main one from
+  // initProfiler
+  u64 totalCounters[PROFILE_COUNTER_COUNT] = {};
+  bool counted = false;
+  pthread_mutex_lock(&profileThreadLock);
+  for (ProfileThread *thread = profileThreads; thread; thread = thread->next) {
+    u64 counters[PROFILE_COUNTER_COUNT];
+    f64 scale;
+    if (readCounterGroup(thread->counterFds[0], counters, &scale)) {
+      for (u32 i = 0; i < PROFILE_COUNTER_COUNT; i++) {
+        totalCounters[i] += counters[i] * scale;
+      }
+      counted = true;
+    }
+    // the totals are read, blocks left after this count nothing
+    closeCounterGroup(thread->counterFds);
+  }
+  pthread_mutex_unlock(&profileThreadLock);
   u64 cpuFreq = EstimateCPUTimerFreq();
 
   printf("\nTotal time: %0.4fms (CPU freq %lu)\n",
-         1000.0 * (f64)totalElapsed / (f64)cpuFreq, cpuFreq);
-  for (u32 i = 0; i < ArrayCount(globalProfileAnchors); i++) {
-    ProfileAnchor *profile = globalProfileAnchors + i;
+         CPUTimerToNanoseconds(totalElapsed) / 1e6, cpuFreq);
+  if (!CPUTimerIsInvariant()) {
+    printf("The TSC isn't invariant, times are only estimates\n");
+  }
+  if (counted) {
+    printf("Counters: %lu instructions in %lu cycles,",
+           totalCounters[PROFILE_COUNTER_INSTRUCTIONS],
+           totalCounters[PROFILE_COUNTER_CYCLES]);
+    PrintCounters(totalCounters);
+    printf("%s\n", atomic_load(&profileCountersScaled)
+                       ? " (multiplexed, totals scaled, blocks undercounted)"
+                       : "");
+  } else if (profileBlockCounters) {
+    printf("Counters: unavailable\n");
+  }
+
+  // percentages are of the wall time, summed over threads they can pass 100
+  static ProfileAnchor merged[PROFILER_MAX_ANCHORS];
+  memset(merged, 0, sizeof(merged));
+  pthread_mutex_lock(&profileThreadLock);
+  for (u32 id = 0; id < profileThreadCount; id++) {
+    ProfileThread *thread = profileThreads;
+    while (thread->id != id) {
+      thread = thread->next;
+    }
+    if (profileThreadCount > 1) {
+      printf("Thread %u:\n", id);
+    }
+    for (u32 i = 0; i < PROFILER_MAX_ANCHORS; i++) {
+      ProfileAnchor *profile = thread->anchors + i;
+      merged[i].allocatedBytes += profile->allocatedBytes;
+      merged[i].allocationCount += profile->allocationCount;
+      merged[i].label = profile->label ? profile->label : merged[i].label;
+      if (profile->elapsedInclusive) {
+        PrintTimeElapsed(profile, cpuFreq, totalElapsed);
+        for (u32 j = 0; j < PROFILE_COUNTER_COUNT; j++) {
+          merged[i].counters[j] += profile->counters[j];
+        }
+        merged[i].elapsedExclusive += profile->elapsedExclusive;
+        merged[i].elapsedInclusive += profile->elapsedInclusive;
+        merged[i].hitCount += profile->hitCount;
+        merged[i].processedByteCount += profile->processedByteCount;
+      }
+    }
+  }
 
-    if (profile->elapsedInclusive) {
-      PrintTimeElapsed(profile, cpuFreq, totalElapsed);
+  if (profileThreadCount > 1) {
+    printf("All threads:\n");
+    for (u32 i = 0; i < PROFILER_MAX_ANCHORS; i++) {
+      if (merged[i].elapsedInclusive) {
+        PrintTimeElapsed(&merged[i], cpuFreq, totalElapsed);
+      }
     }
   }
+  if (profileAllocations) {
+    printAllocations(merged);
+  }
+  pthread_mutex_unlock(&profileThreadLock);
 }
 
+void exitFunctionBlock(ProfileBlock **block) { exitProfileBlock(*block); }
+
+#else
+
+void initProfiler() {}
+void initProfileCounters() {}
+void initProfileAllocations() {}
+void displayProfilingResult() {
+  printf("\nBuilt without the profiler, rebuild with make PROFILER=1\n");
+}
+void initProfileTrace(u32 maxEvents) {}
+bool writeProfileTrace(const char *fileName) { return false; }
+
+#endif
+
 /*
  =========================================
  =========================================
@@ -32,17 +32,66 @@ typedef double f64;
 
 #define PI 3.14159265358979
 
+// address space a virtual arena reserves, only what is committed costs
+// anything
+#define ARENA_RESERVE_SIZE (64ull * 1024 * 1024 * 1024)
+// committed this much at a time so growing rarely needs a syscall
+#define ARENA_COMMIT_STEP (64ull * 1024 * 1024)
+// every push starts at a multiple of this
+#define ARENA_ALIGNMENT 8
+// transparent huge page size on x86-64, the commit step is a multiple of it
+#define ARENA_HUGE_PAGE_SIZE (2ull * 1024 * 1024)
+
+/*
+  A heap arena is one malloc of maxSize. A virtual arena reserves maxSize
+  of address space and commits it as pushes reach it, so pointers stay
+  stable and there's no limit short of the reservation. Running out of
+  either is fatal. A huge page arena is a virtual one aligned and advised
+  for transparent huge pages, one TLB entry then covers 2MB of it. Without
+  THP it behaves like a plain virtual arena and hugePages stays false.
+*/
 struct Arena {
   u64 memory;
   u64 ptr;
   u64 maxSize;
+  u64 committed;
+  u64 highWater;
+  bool reserved;
+  bool hugePages;
 };
 typedef struct Arena Arena;
 u64 sta_arena_push(Arena *arena, u64 size);
+u64 sta_arena_push_tagged(Arena *arena, u64 size, const char *tag);
 void sta_arena_pop(Arena *arena, u64 size);
 void sta_arena_init_heap(Arena *arena, u64 size);
+void sta_arena_init_virtual(Arena *arena, u64 size);
+void sta_arena_init_huge(Arena *arena, u64 size);
+void sta_arena_free(Arena *arena);
+void sta_arena_report(Arena *arena, const char *name);
+
+// everything pushed after the marker is freed at once by restoring it
+struct ArenaMarker {
+  Arena *arena;
+  u64 ptr;
+};
+typedef struct ArenaMarker ArenaMarker;
+ArenaMarker sta_arena_save(Arena *arena);
+void sta_arena_restore(ArenaMarker marker);
+
+/*
+  Every thread has two scratch arenas for temporaries, handed out as a
+  marker that is restored when done. Passing the arena the result goes into
+  as conflict picks the other one, so a function that gets scratch and
+  allocates its result in an arena that is itself scratch further up never
+  frees its own result. Threads free theirs with sta_scratch_free.
+*/
+ArenaMarker sta_get_scratch(Arena *conflict);
+void sta_scratch_free(void);
+// the tag is what the allocation profiler counts it as, a string literal
+#define sta_arena_push_array_tagged(arena, type, count, tag)                   \
+  (type *)sta_arena_push_tagged((arena), sizeof(type) * (count), (tag))
 #define sta_arena_push_array(arena, type, count)                               \
-  (type *)sta_arena_push((arena), sizeof(type) * (count))
+  sta_arena_push_array_tagged((arena), type, (count), #type)
 #define sta_arena_push_struct(arena, type)                                     \
   sta_arena_push_array((arena), type, 1)
 
@@ -82,53 +131,130 @@ typedef struct Profiler Profiler;
 extern Profiler profiler;
 u64 ReadCPUTimer(void);
 u64 EstimateCPUTimerFreq(void);
+u64 CPUTimerToNanoseconds(u64 ticks);
+bool CPUTimerIsInvariant(void);
 
 void initProfiler();
+void initProfileCounters();
+void initProfileAllocations();
 void displayProfilingResult();
+void initProfileTrace(u32 maxEvents);
+bool writeProfileTrace(const char *fileName);
 
+/*
+  Build with -DPROFILER=0 (make PROFILER=0) and the blocks below compile to
+  nothing. Built in, they only measure once initProfiler has run, until
+  then entering one costs a branch.
+*/
+#ifndef PROFILER
 #define PROFILER 1
+#endif
 #if PROFILER
 
+extern bool profilerRunning;
+extern bool profileAllocations;
+void profileAllocation(const char *tag, u64 size);
+
+/*
+  Hardware counters read as one perf event group per thread. Cycles and
+  instructions give IPC, the misses are shown per thousand instructions.
+  Cycles and instructions usually have fixed counters, the misses take
+  three of the general ones, with the NMI watchdog or hyperthreading that
+  is often all there are and a bigger group doesn't count at all.
+*/
+enum ProfileCounter {
+  PROFILE_COUNTER_CYCLES,
+  PROFILE_COUNTER_INSTRUCTIONS,
+  PROFILE_COUNTER_BRANCH_MISSES,
+  PROFILE_COUNTER_CACHE_MISSES,
+  PROFILE_COUNTER_DTLB_MISSES,
+  PROFILE_COUNTER_COUNT,
+};
+typedef enum ProfileCounter ProfileCounter;
+
 struct ProfileAnchor {
+  u64 counters[PROFILE_COUNTER_COUNT]; // exclusive, like elapsedExclusive
   u64 elapsedExclusive;
   u64 elapsedInclusive;
   u64 hitCount;
   u64 processedByteCount;
+  u64 allocatedBytes; // pushed while this was the innermost block
+  u64 allocationCount;
   char const *label;
 };
 typedef struct ProfileAnchor ProfileAnchor;
 
-extern ProfileAnchor globalProfileAnchors[4096];
-extern u32 globalProfilerParentIndex;
+#define PROFILER_MAX_ANCHORS 4096
+
+// bytes pushed under one tag, found by the tag's address
+struct ProfileAllocation {
+  char const *tag;
+  u64 bytes;
+  u64 count;
+};
+typedef struct ProfileAllocation ProfileAllocation;
+
+// a power of two, the tags are the types arrays are pushed as
+#define PROFILER_MAX_ALLOCATION_TAGS 256
+
+/*
+  Every thread that enters a block gets its own anchors and parent index,
+  so blocks can be timed from any thread without locking. The threads are
+  kept in a list for displayProfilingResult to print one by one and merged.
+*/
+struct ProfileThread {
+  ProfileAnchor anchors[PROFILER_MAX_ANCHORS];
+  ProfileAllocation allocations[PROFILER_MAX_ALLOCATION_TAGS];
+  u32 parentIndex;
+  u32 id;
+  i32 counterFds[PROFILE_COUNTER_COUNT]; // the group, leader first, -1 without counters
+  struct ProfileThread *next;
+};
+typedef struct ProfileThread ProfileThread;
 
 struct ProfileBlock {
   char const *label;
   u64 oldElapsedInclusive;
   u64 startTime;
+  u64 startCounters[PROFILE_COUNTER_COUNT];
   u32 parentIndex;
   u32 index;
+  u32 traceSlot; // of its 'B' event, the 'E' goes right after it
 };
 typedef struct ProfileBlock ProfileBlock;
 void initProfileBlock(ProfileBlock *block, char const *label_, u32 index_,
                       u64 byteCount);
 void exitProfileBlock(ProfileBlock *block);
+u32 getProfileAnchor(_Atomic u32 *anchor);
 
 #define NameConcat2(A, B) A##B
 #define NameConcat(A, B) NameConcat2(A, B)
-#define TimeBandwidth(Name, ByteCount)                                         \
+// the anchor index is handed out the first time a block is entered, so
+// blocks in different files and threads never share one. A block that
+// wasn't entered has no label and isn't exited
+#define TimeLabeled(Name, Label, ByteCount)                                    \
+  static _Atomic u32 NameConcat(Name, Anchor);                                 \
   ProfileBlock Name;                                                           \
-  initProfileBlock(&Name, "Name", __COUNTER__ + 1, ByteCount);
+  Name.label = 0;                                                              \
+  if (profilerRunning) {                                                       \
+    initProfileBlock(&Name, Label,                                             \
+                     getProfileAnchor(&NameConcat(Name, Anchor)), ByteCount);  \
+  }
+#define TimeBandwidth(Name, ByteCount) TimeLabeled(Name, #Name, ByteCount)
 #define ExitBlock(Name) exitProfileBlock(&Name)
 #define TimeBlock(Name) TimeBandwidth(Name, 0)
-#define ProfilerEndOfCompilationUnit                                           \
-  static_assert(                                                               \
-      __COUNTER__ < ArrayCount(GlobalProfilerAnchors),                         \
-      "Number of profile points exceeds size of profiler::Anchors array")
-#define TimeFunction TimeBlock(__func__)
+// exited when the function returns, from wherever it returns
+#define TimeFunction                                                           \
+  TimeLabeled(functionBlock, __func__, 0)                                      \
+      ProfileBlock *functionExit                                               \
+      __attribute__((cleanup(exitFunctionBlock), unused)) = &functionBlock;
+void exitFunctionBlock(ProfileBlock **block);
 
 #else
 
-#define TimeBlock(blockName)
+#define TimeBandwidth(Name, ByteCount) (void)sizeof(ByteCount)
+#define ExitBlock(Name)
+#define TimeBlock(Name)
 #define TimeFunction
 #endif
 
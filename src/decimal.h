@@ -0,0 +1,9 @@
+#ifndef DECIMAL_H
+#define DECIMAL_H
+#include "common.h"
+
+// mantissa * 10^exponent rounded to the nearest double, false when the fast
+// paths can't decide and the caller has to fall back to an exact parse
+bool decimal_to_double(u64 mantissa, i32 exponent, f64* out);
+
+#endif
@@ -1,9 +1,15 @@
+// MAP_ANONYMOUS and madvise are outside of c11
+#define _DEFAULT_SOURCE
 #include "files.h"
 #include "common.h"
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void sta_draw_rect_to_image(Image* image, u64 x, u64 y, u64 width, u64 height, u8 r, u8 g, u8 b, u8 a)
 {
@@ -91,6 +97,60 @@ bool sta_read_file(Arena* arena, struct String* string, const char* fileName)
   return true;
 }
 
+// the file's pages rounded up plus one more of padding
+static u64 mapped_size(u64 len)
+{
+  u64 page = sysconf(_SC_PAGESIZE);
+  return (len + page - 1) / page * page + page;
+}
+
+bool sta_map_file(String* string, const char* fileName)
+{
+  i32 fd = open(fileName, O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  // the whole range is reserved as zero pages first and the file mapped over
+  // the front, so the padding can't be taken by another mapping
+  u64   size   = mapped_size(info.st_size);
+  char* memory = mmap(0, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+  {
+    close(fd);
+    return false;
+  }
+  if (info.st_size > 0 && mmap(memory, info.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    munmap(memory, size);
+    close(fd);
+    return false;
+  }
+  madvise(memory, size, MADV_SEQUENTIAL);
+  close(fd);
+
+  string->buffer = memory;
+  string->len    = info.st_size;
+  return true;
+}
+
+void sta_unmap_file(String* string)
+{
+  munmap(string->buffer, mapped_size(string->len));
+}
+
+bool sta_load_file(Arena* arena, String* string, const char* fileName, FileLoad load)
+{
+  return load == FILE_MAP ? sta_map_file(string, fileName) : sta_read_file(arena, string, fileName);
+}
+
 bool sta_read_targa_from_file(Arena* arena, Image* image, const char* filename)
 {
 
@@ -238,11 +298,12 @@ bool sta_read_csv_from_string(CSV* csv, String csvData)
   return true;
 }
 
-bool sta_read_csv_from_file(Arena* arena, CSV* csv, String fileLocation)
+// the fields are slices of the file, a mapped file stays mapped
+bool sta_read_csv_from_file(Arena* arena, CSV* csv, String fileLocation, FileLoad load)
 {
   String fileData;
 
-  bool   result = sta_read_file(arena, &fileData, fileLocation.buffer);
+  bool   result = sta_load_file(arena, &fileData, fileLocation.buffer, load);
   if (!result)
   {
     return false;
@@ -763,16 +824,26 @@ static bool parseJsonValue(JsonValue* value, char* buffer, u64* curr)
   }
 }
 
-bool sta_deserialize_json_from_file(Arena* arena, Json* json, const char* filename)
+// keys and strings are copied out, a mapped file is unmapped when done
+static bool deserialize_json(Json* json, String fileContent);
+
+bool sta_deserialize_json_from_file(Arena* arena, Json* json, const char* filename, FileLoad load)
 {
   String fileContent;
-  bool   result;
-
-  result = sta_read_file(arena, &fileContent, filename);
-  if (!result)
+  if (!sta_load_file(arena, &fileContent, filename, load))
   {
     return false;
   }
+  bool result = deserialize_json(json, fileContent);
+  if (load == FILE_MAP)
+  {
+    sta_unmap_file(&fileContent);
+  }
+  return result;
+}
+
+static bool deserialize_json(Json* json, String fileContent)
+{
   u64  curr = 0;
   bool res;
   bool first = false;
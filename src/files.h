@@ -117,11 +117,23 @@ struct Json
 };
 typedef struct Json Json;
 
-bool                sta_deserialize_json_from_file(Arena* arena, Json* json, const char* filename);
+/*
+  FILE_READ copies the file into the arena and ends it with a 0. FILE_MAP
+  points straight at the page cache, the bytes after the end up to the next
+  page and at least one whole page more read as 0.
+*/
+enum FileLoad
+{
+  FILE_READ,
+  FILE_MAP
+};
+typedef enum FileLoad FileLoad;
+
+bool                sta_deserialize_json_from_file(Arena* arena, Json* json, const char* filename, FileLoad load);
 bool                sta_serialize_json_to_file(Json* json, const char* filename);
 void                sta_debug_json(Json* json);
 
-bool                sta_read_csv_from_file(Arena* arena, CSV* csv, String fileLocation);
+bool                sta_read_csv_from_file(Arena* arena, CSV* csv, String fileLocation, FileLoad load);
 bool                sta_write_csv_to_file(CSV* csv, String fileLocation);
 void                sta_debug_csv(CSV* csv);
 bool                sta_read_csv_from_string(CSV* csv, String csvData);
@@ -129,6 +141,9 @@ bool                sta_read_csv_from_string(CSV* csv, String csvData);
 void                sta_draw_rect_to_image(Image* image, u64 x, u64 y, u64 width, u64 height, u8 r, u8 g, u8 b, u8 a);
 bool                sta_read_targa_from_file(Arena* arena, struct Image* image, const char* filename);
 bool                sta_read_file(Arena* arena, struct String* string, const char* fileName);
+bool                sta_map_file(String* string, const char* fileName);
+void                sta_unmap_file(String* string);
+bool                sta_load_file(Arena* arena, String* string, const char* fileName, FileLoad load);
 bool                sta_append_to_file(String fileName, String message);
 bool                sta_write_ppm(String fileName, Image* image);
 
@@ -0,0 +1,96 @@
+#include "intern.h"
+#include "common.h"
+#include "scanner.h"
+#include <string.h>
+
+// identifiers are short, eight bytes at a time is one or two rounds
+static u32 hash_name(String name)
+{
+  u64 hash = 0x9E3779B97F4A7C15 ^ name.len;
+  u64 i    = 0;
+  for (; i + 8 <= name.len; i += 8)
+  {
+    u64 word;
+    memcpy(&word, &name.buffer[i], 8);
+    hash = (hash ^ word) * 0xFF51AFD7ED558CCD;
+    hash ^= hash >> 32;
+  }
+  u64 tail = 0;
+  memcpy(&tail, &name.buffer[i], name.len - i);
+  hash = (hash ^ tail) * 0xFF51AFD7ED558CCD;
+  hash ^= hash >> 29;
+  return (u32)hash;
+}
+
+// slots stay at most half full, the ids are reinserted from their stored hashes
+static void grow_intern_table(InternTable* table, Arena* arena)
+{
+  u32     capacity = table->capacity ? table->capacity * 2 : 64;
+  u32*    hashes   = sta_arena_push_array_tagged(arena, u32, capacity, "InternTable");
+  String* names    = sta_arena_push_array_tagged(arena, String, capacity, "InternTable");
+  if (table->count)
+  {
+    memcpy(hashes, table->hashes, table->count * sizeof(u32));
+    memcpy(names, table->names, table->count * sizeof(String));
+  }
+
+  u32  slot_count = capacity * 2;
+  u32* slots      = sta_arena_push_array_tagged(arena, u32, slot_count, "InternTable");
+  memset(slots, 0, slot_count * sizeof(u32));
+  for (u32 symbol = 0; symbol < table->count; symbol++)
+  {
+    u32 slot = hashes[symbol] & (slot_count - 1);
+    while (slots[slot] != 0)
+    {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    slots[slot] = symbol + 1;
+  }
+
+  table->slots      = slots;
+  table->hashes     = hashes;
+  table->names      = names;
+  table->capacity   = capacity;
+  table->slot_count = slot_count;
+}
+
+u32 intern(InternTable* table, Arena* arena, String name)
+{
+  if (table->count == table->capacity)
+  {
+    grow_intern_table(table, arena);
+  }
+
+  u32 hash = hash_name(name);
+  u32 slot = hash & (table->slot_count - 1);
+  while (table->slots[slot] != 0)
+  {
+    u32     symbol = table->slots[slot] - 1;
+    String* other  = &table->names[symbol];
+    if (table->hashes[symbol] == hash && other->len == name.len && memcmp(other->buffer, name.buffer, name.len) == 0)
+    {
+      return symbol;
+    }
+    slot = (slot + 1) & (table->slot_count - 1);
+  }
+
+  // the id has to fit the token's value
+  if (table->count == 1 << 24)
+  {
+    error("Too many identifiers!");
+  }
+  u32 symbol            = table->count++;
+  table->hashes[symbol] = hash;
+  table->names[symbol]  = name;
+  table->slots[slot]    = symbol + 1;
+  if (table->copy_names)
+  {
+    sta_strcpy(arena, &table->names[symbol], &name);
+  }
+  return symbol;
+}
+
+String symbol_name(InternTable* table, u32 symbol)
+{
+  return table->names[symbol];
+}
@@ -0,0 +1,26 @@
+#ifndef INTERN_H
+#define INTERN_H
+#include "common.h"
+
+/*
+  Every distinct identifier gets a dense id in the order it was first seen,
+  so comparing names is comparing ids and per name data is an array indexed
+  by id. The names point into the input unless copy_names is set, for
+  inputs that don't stay in memory.
+*/
+struct InternTable
+{
+  u32*    slots; // id + 1, 0 is empty
+  u32*    hashes;
+  String* names;
+  u32     count;
+  u32     capacity;
+  u32     slot_count;
+  bool    copy_names;
+};
+typedef struct InternTable InternTable;
+
+u32    intern(InternTable* table, Arena* arena, String name);
+String symbol_name(InternTable* table, u32 symbol);
+
+#endif
@@ -0,0 +1,276 @@
+#include "jobs.h"
+#include "common.h"
+#include <sched.h>
+#include <stdlib.h>
+
+// failed rounds of looking for work before a worker goes to sleep
+#define JOB_SPIN_COUNT 64
+// parallel_for hands every worker this many batches so stealing can even
+// out items of uneven cost
+#define JOB_BATCHES_PER_WORKER 4
+
+static _Thread_local Worker* current_worker;
+
+static bool push_deque(JobDeque* deque, Job* job)
+{
+  i64 bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+  i64 top    = atomic_load_explicit(&deque->top, memory_order_acquire);
+  if (bottom - top >= JOB_DEQUE_CAPACITY)
+  {
+    return false;
+  }
+  atomic_store_explicit(&deque->jobs[bottom % JOB_DEQUE_CAPACITY], job, memory_order_relaxed);
+  atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+  return true;
+}
+
+static Job* pop_deque(JobDeque* deque)
+{
+  i64 bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  i64 top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+  if (top > bottom)
+  {
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return 0;
+  }
+
+  Job* job = atomic_load_explicit(&deque->jobs[bottom % JOB_DEQUE_CAPACITY], memory_order_relaxed);
+  if (top == bottom)
+  {
+    // the last job, a thief may be taking it at the same time
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+    {
+      job = 0;
+    }
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+  }
+  return job;
+}
+
+static Job* steal_deque(JobDeque* deque)
+{
+  i64 top = atomic_load_explicit(&deque->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  i64 bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+  if (top >= bottom)
+  {
+    return 0;
+  }
+  Job* job = atomic_load_explicit(&deque->jobs[top % JOB_DEQUE_CAPACITY], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+  {
+    return 0;
+  }
+  return job;
+}
+
+// its own deque first, newest job first, then the oldest job of the others
+// starting from a random one
+static Job* find_job(Worker* worker)
+{
+  JobSystem* system = worker->system;
+  Job*       job    = pop_deque(&worker->deque);
+  if (!job)
+  {
+    worker->seed = worker->seed * 1664525 + 1013904223;
+    u32 first    = (worker->seed >> 16) % system->worker_count;
+    for (u32 i = 0; i < system->worker_count && !job; i++)
+    {
+      Worker* victim = &system->workers[(first + i) % system->worker_count];
+      if (victim != worker)
+      {
+        job = steal_deque(&victim->deque);
+      }
+    }
+  }
+  if (job)
+  {
+    atomic_fetch_sub(&system->queued, 1);
+  }
+  return job;
+}
+
+static void run_job(Worker* worker, Job* job)
+{
+  job->function(job->data, &worker->arena);
+  atomic_fetch_sub_explicit(job->remaining, 1, memory_order_release);
+}
+
+static void* worker_main(void* data)
+{
+  Worker*    worker = data;
+  JobSystem* system = worker->system;
+  current_worker    = worker;
+
+  u32 idle          = 0;
+  while (atomic_load(&system->running))
+  {
+    Job* job = find_job(worker);
+    if (job)
+    {
+      run_job(worker, job);
+      idle = 0;
+      continue;
+    }
+    if (++idle < JOB_SPIN_COUNT)
+    {
+      sched_yield();
+      continue;
+    }
+
+    // queued is checked under the lock push_job signals under, no wakeup
+    // can be lost between the check and the wait
+    pthread_mutex_lock(&system->lock);
+    system->sleeping++;
+    while (atomic_load(&system->queued) == 0 && atomic_load(&system->running))
+    {
+      pthread_cond_wait(&system->wake, &system->lock);
+    }
+    system->sleeping--;
+    pthread_mutex_unlock(&system->lock);
+    idle = 0;
+  }
+  sta_scratch_free();
+  return 0;
+}
+
+void init_job_system(JobSystem* system, u32 worker_count)
+{
+  system->worker_count = MAX(worker_count, 1);
+  system->workers      = calloc(system->worker_count, sizeof(Worker));
+  system->sleeping     = 0;
+  atomic_init(&system->running, true);
+  atomic_init(&system->queued, 0);
+  pthread_mutex_init(&system->lock, 0);
+  pthread_cond_init(&system->wake, 0);
+
+  for (u32 i = 0; i < system->worker_count; i++)
+  {
+    Worker* worker = &system->workers[i];
+    worker->system = system;
+    worker->index  = i;
+    worker->seed   = i + 1;
+    atomic_init(&worker->deque.top, 0);
+    atomic_init(&worker->deque.bottom, 0);
+    sta_arena_init_virtual(&worker->arena, ARENA_RESERVE_SIZE);
+  }
+  current_worker = &system->workers[0];
+  for (u32 i = 1; i < system->worker_count; i++)
+  {
+    pthread_create(&system->workers[i].thread, 0, worker_main, &system->workers[i]);
+  }
+}
+
+void shutdown_job_system(JobSystem* system)
+{
+  pthread_mutex_lock(&system->lock);
+  atomic_store(&system->running, false);
+  pthread_cond_broadcast(&system->wake);
+  pthread_mutex_unlock(&system->lock);
+
+  for (u32 i = 0; i < system->worker_count; i++)
+  {
+    if (i > 0)
+    {
+      pthread_join(system->workers[i].thread, 0);
+    }
+    sta_arena_free(&system->workers[i].arena);
+  }
+  pthread_mutex_destroy(&system->lock);
+  pthread_cond_destroy(&system->wake);
+  free(system->workers);
+  current_worker = 0;
+}
+
+// only from a thread of the job system, job has to stay valid until it ran
+void push_job(JobSystem* system, Job* job)
+{
+  Worker* worker = current_worker;
+  if (!worker || worker->system != system)
+  {
+    printf("Jobs can only be pushed from a worker of their job system!\n");
+    exit(1);
+  }
+  if (!push_deque(&worker->deque, job))
+  {
+    run_job(worker, job);
+    return;
+  }
+
+  atomic_fetch_add(&system->queued, 1);
+  pthread_mutex_lock(&system->lock);
+  if (system->sleeping > 0)
+  {
+    pthread_cond_signal(&system->wake);
+  }
+  pthread_mutex_unlock(&system->lock);
+}
+
+// runs jobs, its own or stolen, until remaining reaches 0
+void wait_for_jobs(JobSystem* system, _Atomic u32* remaining)
+{
+  Worker* worker = current_worker;
+  while (atomic_load_explicit(remaining, memory_order_acquire) != 0)
+  {
+    Job* job = find_job(worker);
+    if (job)
+    {
+      run_job(worker, job);
+    }
+    else
+    {
+      sched_yield();
+    }
+  }
+}
+
+typedef struct
+{
+  JobFunction function;
+  u8*         items;
+  u64         item_size;
+  u32         first;
+  u32         end;
+} ForBatch;
+
+static void run_batch(void* data, Arena* arena)
+{
+  ForBatch* batch = data;
+  for (u32 i = batch->first; i < batch->end; i++)
+  {
+    batch->function(&batch->items[i * batch->item_size], arena);
+  }
+}
+
+// function is called once per item, in batches of consecutive items, and
+// everything has run when this returns
+void parallel_for(JobSystem* system, void* items, u32 count, u64 item_size, JobFunction function)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  u32         batch_count = MIN(count, system->worker_count * JOB_BATCHES_PER_WORKER);
+  ArenaMarker scratch     = sta_get_scratch(0);
+  ForBatch*   batches     = sta_arena_push_array(scratch.arena, ForBatch, batch_count);
+  Job*        jobs        = sta_arena_push_array(scratch.arena, Job, batch_count);
+  _Atomic u32 remaining;
+  atomic_init(&remaining, batch_count);
+
+  for (u32 i = 0; i < batch_count; i++)
+  {
+    batches[i] = (ForBatch){
+        .function  = function,
+        .items     = items,
+        .item_size = item_size,
+        .first     = (u64)count * i / batch_count,
+        .end       = (u64)count * (i + 1) / batch_count,
+    };
+    jobs[i] = (Job){.function = run_batch, .data = &batches[i], .remaining = &remaining};
+    push_job(system, &jobs[i]);
+  }
+  wait_for_jobs(system, &remaining);
+  sta_arena_restore(scratch);
+}
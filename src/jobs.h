@@ -0,0 +1,67 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include "common.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+// gets the arena of the worker running it, which lives as long as the job
+// system and is never reset by it
+typedef void (*JobFunction)(void* data, Arena* arena);
+
+struct Job
+{
+  JobFunction  function;
+  void*        data;
+  _Atomic u32* remaining; // decremented once the job has run
+};
+typedef struct Job Job;
+
+/*
+  Chase-Lev deque of jobs. The worker owning it pushes and pops at the
+  bottom, the others steal from the top. Pushing to a full deque fails and
+  the job is run right away instead.
+*/
+#define JOB_DEQUE_CAPACITY 1024
+
+struct JobDeque
+{
+  _Atomic(Job*) jobs[JOB_DEQUE_CAPACITY];
+  _Atomic i64   top;
+  _Atomic i64   bottom;
+};
+typedef struct JobDeque JobDeque;
+
+struct Worker
+{
+  JobDeque          deque;
+  Arena             arena;
+  pthread_t         thread;
+  struct JobSystem* system;
+  u32               index;
+  u32               seed; // picks who to steal from
+};
+typedef struct Worker Worker;
+
+/*
+  Worker 0 is the thread that called init_job_system, it runs jobs while it
+  waits for them. The others sleep when nothing has been queued.
+*/
+struct JobSystem
+{
+  Worker*         workers;
+  u32             worker_count;
+  _Atomic bool    running;
+  _Atomic u32     queued;
+  u32             sleeping;
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+};
+typedef struct JobSystem JobSystem;
+
+void init_job_system(JobSystem* system, u32 worker_count);
+void shutdown_job_system(JobSystem* system);
+void push_job(JobSystem* system, Job* job);
+void wait_for_jobs(JobSystem* system, _Atomic u32* remaining);
+void parallel_for(JobSystem* system, void* items, u32 count, u64 item_size, JobFunction function);
+
+#endif
@@ -3,8 +3,19 @@
 #include "files.h"
 #include "parser.h"
 #include "scanner.h"
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// below this, starting threads costs more than lexing the file
+#define PARALLEL_LEX_MIN_SIZE (4 * 1024 * 1024)
+// a begin and an end per block entered, 32MB of events at most
+#define PROFILE_TRACE_MAX_EVENTS (1024 * 1024)
+// a single token has to fit in half of it, comments and blanks can be longer
+#define STREAM_WINDOW_SIZE (1024 * 1024)
 
 int main(int argc, char** argv)
 {
@@ -13,26 +24,124 @@ int main(int argc, char** argv)
     printf("Need filename!\n");
     return 1;
   }
+  bool        profile     = false;
+  bool        stream      = false;
+  bool        huge_pages  = false;
+  bool        counters    = false;
+  bool        allocations = false;
+  bool        arena_usage = false;
+  const char* trace       = 0;
+  for (i32 i = 2; i < argc; i++)
+  {
+    profile |= strcmp(argv[i], "--profile") == 0;
+    stream |= strcmp(argv[i], "--stream") == 0;
+    huge_pages |= strcmp(argv[i], "--huge-pages") == 0;
+    // hardware counters per profile block, every block pays two syscalls
+    counters |= strcmp(argv[i], "--counters") == 0;
+    allocations |= strcmp(argv[i], "--allocations") == 0;
+    // what the arena committed and the most it held, no profiler needed
+    arena_usage |= strcmp(argv[i], "--arena") == 0;
+    if (strncmp(argv[i], "--trace=", 8) == 0)
+    {
+      trace = argv[i] + 8;
+    }
+  }
+  profile |= counters || allocations;
+  if (profile || trace)
+  {
+    initProfiler();
+  }
+  if (counters)
+  {
+    initProfileCounters();
+  }
+  if (allocations)
+  {
+    initProfileAllocations();
+  }
+  if (trace)
+  {
+    initProfileTrace(PROFILE_TRACE_MAX_EVENTS);
+  }
+
+  // tokens and the ast both live here
   String file     = {};
-  i32    size     = 4096 * 4096;
   Arena  arena    = {};
-  arena.ptr       = 0;
-  arena.memory    = (u64)malloc(size);
-  arena.maxSize   = size;
-  Scanner scanner = {};
+  if (huge_pages)
+  {
+    sta_arena_init_huge(&arena, ARENA_RESERVE_SIZE);
+  }
+  else
+  {
+    sta_arena_init_virtual(&arena, ARENA_RESERVE_SIZE);
+  }
+  Scanner     scanner = {};
+  Parser      parser  = {};
+  TokenBuffer tokens  = {}; // the parser reads them until it's done
+  u64         size    = 0;  // of the input, for the profiler's bytes per second
 
-  bool    read    = sta_read_file(&arena, &file, argv[1]);
-  if (!read)
+  if (stream)
   {
-    printf("Couldn't read file %s\n", argv[1]);
-    return 1;
+    // only the window is held, tokens are lexed as the parser asks for them
+    i32 fd = open(argv[1], O_RDONLY);
+    if (fd < 0)
+    {
+      printf("Couldn't read file %s\n", argv[1]);
+      return 1;
+    }
+    struct stat status;
+    size = fstat(fd, &status) == 0 ? status.st_size : 0;
+    init_stream_scanner(&scanner, &arena, fd, STREAM_WINDOW_SIZE, argv[1]);
+    init_parser(&parser, &scanner, 0);
   }
-  init_scanner(&scanner, &arena, &file, argv[1]);
+  else
+  {
+    // mapped, the file isn't copied and doesn't count against the arena,
+    // the pages are read as the lexer first touches them
+    TimeBlock(reading);
+    bool read = sta_map_file(&file, argv[1]);
+    ExitBlock(reading);
+    if (!read)
+    {
+      printf("Couldn't read file %s\n", argv[1]);
+      return 1;
+    }
+    size = file.len;
+    init_scanner(&scanner, &arena, &file, argv[1]);
+
+    JobSystem jobs        = {};
+    u32       chunk_count = file.len >= PARALLEL_LEX_MIN_SIZE ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    init_job_system(&jobs, chunk_count);
+    TimeBandwidth(lexing, size);
+    scan_tokens_parallel(&scanner, &tokens, &jobs, chunk_count);
+    ExitBlock(lexing);
+    shutdown_job_system(&jobs);
+    init_parser(&parser, &scanner, &tokens);
+  }
+
+  // streamed input is lexed while it's parsed
+  TimeBandwidth(parsing, size);
+  Ast* ast = parse(&parser);
+  ExitBlock(parsing);
+  TimeBandwidth(printing, size);
+  debug_ast(ast);
+  ExitBlock(printing);
+  free_parser(&parser);
 
-  Parser parser = {};
-  init_parser(&parser, &scanner);
-  AstNode* head = parse(&parser);
-  debug_node(head, 0);
+  if (profile)
+  {
+    displayProfilingResult();
+  }
+  // the peak goes with the allocation tables
+  if (arena_usage || allocations)
+  {
+    sta_arena_report(&arena, "main");
+  }
+  if (trace && !writeProfileTrace(trace))
+  {
+    printf("Couldn't write trace %s\n", trace);
+    return 1;
+  }
 
   return 0;
 }
@@ -7,21 +7,21 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define ALLOC(parser, type)    (sta_arena_push_struct(parser->scanner->arena, type))
-#define ALLOC_NODE(parser)     (ALLOC(parser, AstNode))
-#define CURRENT_TYPE(parser)   parser->current->type
+#define CURRENT_TYPE(parser)   parser->current.type
 #define CURRENT_MEMORY(parser) (parser->scanner->arena->memory + parser->scanner->arena->ptr)
-
-static void      parse_constant(Parser* parser, bool can_assign);
-static void      parse_binary(Parser* parser, bool can_assign);
-static void      parse_comparison(Parser* parser, bool can_assign);
-static void      parse_unary(Parser* parser, bool can_assign);
-static void      parse_postfix(Parser* parser, bool can_assign);
-static void      parse_variable(Parser* parser, bool can_assign);
-static void      parse_expression(Parser* parser, Precedence precedence);
-static void      parse_stmt(Parser* parser);
-static void      parse_block(Parser* parser);
-static void      parse_declaration(Parser* parser);
+#define AST(parser)            (&(parser)->ast)
+
+static NodeIndex parse_constant(Parser* parser, bool can_assign);
+static NodeIndex parse_binary(Parser* parser, NodeIndex left, bool can_assign);
+static NodeIndex parse_comparison(Parser* parser, NodeIndex left, bool can_assign);
+static NodeIndex parse_assignment(Parser* parser, NodeIndex target, bool can_assign);
+static NodeIndex parse_unary(Parser* parser, bool can_assign);
+static NodeIndex parse_postfix(Parser* parser, NodeIndex left, bool can_assign);
+static NodeIndex parse_variable(Parser* parser, bool can_assign);
+static NodeIndex parse_expression(Parser* parser, Precedence precedence);
+static NodeIndex parse_stmt(Parser* parser);
+static NodeIndex parse_block(Parser* parser);
+static NodeIndex parse_declaration(Parser* parser);
 
 static ParseRule rules[] = {
     [TOKEN_CHARACTER_CONSTANT] = {parse_constant,                0, PREC_ASSIGNMENT},
@@ -77,7 +77,7 @@ static ParseRule rules[] = {
     [TOKEN_ELLIPSIS]           = {             0,                0,       PREC_NONE},
     [TOKEN_MINUS]              = {             0,                0,       PREC_NONE},
     [TOKEN_PLUS]               = {             0,     parse_binary,       PREC_TERM},
-    [TOKEN_SLASH]              = {             0,     parse_binary,       PREC_TERM},
+    [TOKEN_SLASH]              = {             0,     parse_binary,     PREC_FACTOR},
     [TOKEN_STAR]               = {             0,     parse_binary,     PREC_FACTOR},
     [TOKEN_MOD]                = {             0,     parse_binary,     PREC_FACTOR},
     [TOKEN_SHIFT_RIGHT]        = {             0,                0,       PREC_NONE},
@@ -86,15 +86,15 @@ static ParseRule rules[] = {
     [TOKEN_COMMA]              = {             0,                0,       PREC_NONE},
     [TOKEN_DOT]                = {             0,                0,       PREC_NONE},
     [TOKEN_BANG]               = {             0,                0,       PREC_NONE},
-    [TOKEN_BANG_EQUAL]         = {             0, parse_comparison, PREC_COMPARISON},
-    [TOKEN_EQUAL]              = {             0, parse_comparison, PREC_COMPARISON},
-    [TOKEN_EQUAL_EQUAL]        = {             0, parse_comparison, PREC_COMPARISON},
+    [TOKEN_BANG_EQUAL]         = {             0, parse_comparison,   PREC_EQUALITY},
+    [TOKEN_EQUAL]              = {             0, parse_assignment, PREC_ASSIGNMENT},
+    [TOKEN_EQUAL_EQUAL]        = {             0, parse_comparison,   PREC_EQUALITY},
     [TOKEN_GREATER]            = {             0, parse_comparison, PREC_COMPARISON},
     [TOKEN_GREATER_EQUAL]      = {             0, parse_comparison, PREC_COMPARISON},
     [TOKEN_LESS]               = {             0, parse_comparison, PREC_COMPARISON},
     [TOKEN_LESS_EQUAL]         = {             0, parse_comparison, PREC_COMPARISON},
-    [TOKEN_INCREMENT]          = {   parse_unary,    parse_postfix,       PREC_TERM},
-    [TOKEN_DECREMENT]          = {   parse_unary,    parse_postfix,       PREC_TERM},
+    [TOKEN_INCREMENT]          = {   parse_unary,    parse_postfix,       PREC_CALL},
+    [TOKEN_DECREMENT]          = {   parse_unary,    parse_postfix,       PREC_CALL},
     [TOKEN_IDENTIFIER]         = {parse_variable,                0,       PREC_NONE},
     [TOKEN_AND_LOGICAL]        = {             0,                0,       PREC_NONE},
     [TOKEN_OR_LOGICAL]         = {             0,                0,       PREC_NONE},
@@ -104,18 +104,40 @@ static ParseRule rules[] = {
     [TOKEN_EOF]                = {             0,                0,       PREC_NONE}
 };
 
-void init_parser(Parser* parser, Scanner* scanner)
+// tokens may be 0, the parser then lexes one token at a time as it goes
+void init_parser(Parser* parser, Scanner* scanner, TokenBuffer* tokens)
 {
-  parser->scanner  = scanner;
-  parser->current  = 0;
-  parser->previous = 0;
+  parser->scanner        = scanner;
+  parser->tokens         = tokens;
+  parser->token_index    = 0;
+  parser->current        = (Token){};
+  parser->previous       = (Token){};
+  parser->stack          = 0;
+  parser->stack_count    = 0;
+  parser->stack_capacity = 0;
+  sta_arena_init_virtual(&parser->symbol_arena, ARENA_RESERVE_SIZE);
+  init_symbol_table(&parser->symbols, &parser->symbol_arena);
+  init_ast(&parser->ast, scanner->arena, scanner, tokens ? tokens->count + 1 : 0);
 }
 static void advance(Parser* parser)
 {
   parser->previous = parser->current;
-  parser->current  = parse_token(parser->scanner);
+  if (parser->tokens)
+  {
+    parser->current = get_token(parser->tokens, parser->token_index++);
+  }
+  else
+  {
+    parser->current = parse_token(parser->scanner);
+  }
 
-  printf("New current %.*s\n", (i32)parser->current->literal.len, parser->current->literal.buffer);
+  String literal = token_literal(parser->scanner, parser->current);
+  printf("New current %.*s\n", (i32)literal.len, literal.buffer);
+}
+
+static void parse_error(Parser* parser, const char* msg)
+{
+  error_at_token(parser->scanner, parser->current, msg);
 }
 
 static bool is_at_end(Parser* parser)
@@ -205,11 +227,13 @@ static DataType parse_data_type(Parser* parser)
   }
   case TOKEN_IDENTIFIER:
   {
+    out.type          = DATA_TYPE_STRUCT;
+    out.strukt.symbol = parser->current.value;
     break;
   }
   default:
   {
-    error("Expected struct or variable type?");
+    parse_error(parser, "Expected struct or variable type?");
   }
   }
 
@@ -226,12 +250,13 @@ static void consume(Parser* parser, TokenType type, const char* msg)
 {
   if (!match(parser, type))
   {
-    error(msg);
+    parse_error(parser, msg);
   }
 }
+// any type name, struct, union, enum or typedef
 static bool is_struct(Parser* parser)
 {
-  return false;
+  return CURRENT_TYPE(parser) == TOKEN_IDENTIFIER && lookup_symbol(&parser->symbols, parser->current.value, 0);
 }
 
 static int get_type_qualifier(TokenType type)
@@ -285,145 +310,147 @@ static int get_storage_specifier(TokenType type)
   }
 }
 
-static void variable_declaration(Parser* parser, DataType type, String* name, char type_qualifier, char storage_specifier)
+/*
+  The entries of the lists still being parsed are pushed on one stack. A
+  list nested in another one is finished before the outer one gets its
+  next entry, so each list is on top when it ends and is copied to extra
+  in one piece.
+*/
+static void push_child(Parser* parser, u32 child)
 {
-  AstNode* node               = parser->node;
-  parser->node->type          = NODE_DECLARATION;
-  DeclarationNode* variable   = &parser->node->declaration;
-  variable->type_qualifier    = type_qualifier;
-  variable->storage_specifier = storage_specifier;
-  variable->type              = type;
-
-  node->declaration.variables = ALLOC_NODE(parser);
-  AstNode* curr               = node->declaration.variables;
-  do
+  if (parser->stack_count == parser->stack_capacity)
   {
-
-    parser->node = curr;
-    curr->type   = NODE_VARIABLE;
-    if (name == 0)
-    {
-      consume(parser, TOKEN_IDENTIFIER, "Expected variable name");
-      curr->variable.name = &parser->previous->literal;
-    }
-    else
+    u32  capacity = parser->stack_capacity ? parser->stack_capacity * 2 : 64;
+    u32* stack    = sta_arena_push_array_tagged(parser->scanner->arena, u32, capacity, "ParserStack");
+    if (parser->stack_count)
     {
-      curr->variable.name = name;
-      name                = 0;
+      memcpy(stack, parser->stack, parser->stack_count * sizeof(u32));
     }
+    parser->stack          = stack;
+    parser->stack_capacity = capacity;
+  }
+  parser->stack[parser->stack_count++] = child;
+}
+
+static u32 end_list(Parser* parser, u32 start)
+{
+  u32 list = push_extra(AST(parser), parser->stack_count - start);
+  for (u32 i = start; i < parser->stack_count; i++)
+  {
+    push_extra(AST(parser), parser->stack[i]);
+  }
+  parser->stack_count = start;
+  return list;
+}
 
+// the name of the first variable was read to tell it from a function
+static NodeIndex variable_declaration(Parser* parser, Token start, DataType type, Token name, char type_qualifier, char storage_specifier)
+{
+  u32 variables = parser->stack_count;
+  while (true)
+  {
+    NodeIndex value = 0;
     if (match(parser, TOKEN_EQUAL))
     {
-      curr->variable.value = ALLOC_NODE(parser);
-      parser->node         = curr->variable.value;
-      parse_expression(parser, PREC_ASSIGNMENT);
+      value = parse_expression(parser, PREC_ASSIGNMENT);
     }
+    push_child(parser, push_node(AST(parser), NODE_VARIABLE, name, value, 0));
 
-    if (match(parser, TOKEN_COMMA))
-    {
-      curr->next = ALLOC_NODE(parser);
-      curr       = curr->next;
-    }
-    else
+    if (!match(parser, TOKEN_COMMA))
     {
       break;
     }
-
-  } while (true);
+    consume(parser, TOKEN_IDENTIFIER, "Expected variable name");
+    name = parser->previous;
+  }
 
   consume(parser, TOKEN_SEMICOLON, "Expected ';' after variable declaration");
+  u32 specifiers = push_extra(AST(parser), type_qualifier | storage_specifier << 8);
+  end_list(parser, variables);
+  return push_node(AST(parser), NODE_DECLARATION, start, push_type(AST(parser), type), specifiers);
 }
 
-static void parse_variable(Parser* parser, bool can_assign)
+static NodeIndex parse_variable(Parser* parser, bool can_assign)
 {
-  AstNode* node        = parser->node;
-  node->type           = NODE_CONSTANT;
-  node->constant.token = parser->previous;
+  return push_node(AST(parser), NODE_IDENTIFIER, parser->previous, 0, 0);
 }
 
-static void parse_comparison(Parser* parser, bool can_assign)
+/*
+  Operators build the tree bottom up, the right operand is parsed before
+  the node joining it to the left one is made, so every node is written
+  once. The right operand only takes tighter operators, so a - b - c
+  groups to the left.
+*/
+static NodeIndex parse_comparison(Parser* parser, NodeIndex left, bool can_assign)
 {
-  AstNode* left_node = ALLOC_NODE(parser);
-  memcpy(left_node, parser->node, sizeof(AstNode));
-  memset(parser->node, 0, sizeof(AstNode));
-  parser->node->type             = NODE_COMPARISON;
-  parser->node->comparison.left  = left_node;
-  parser->node->comparison.op    = parser->previous->type;
-  parser->node->comparison.right = ALLOC_NODE(parser);
-  parser->node                   = parser->node->comparison.right;
-
-  parse_expression(parser, rules[parser->previous->type].precedence);
+  Token     op    = parser->previous;
+  NodeIndex right = parse_expression(parser, rules[op.type].precedence + 1);
+  return push_node(AST(parser), NODE_COMPARISON, op, left, right);
 }
 
-static void parse_unary(Parser* parser, bool can_assign)
+static NodeIndex parse_unary(Parser* parser, bool can_assign)
 {
   assert(0 && "Not implemented");
+  return 0;
 }
-static void parse_postfix(Parser* parser, bool can_assign)
+static NodeIndex parse_postfix(Parser* parser, NodeIndex left, bool can_assign)
 {
-  AstNode* postfix_node = ALLOC_NODE(parser);
-  memcpy(postfix_node, parser->node, sizeof(AstNode));
-  memset(parser->node, 0, sizeof(AstNode));
-  parser->node->type            = NODE_POSTFIX;
-  parser->node->postfix.postfix = parser->previous;
-  parser->node->postfix.node    = postfix_node;
+  return push_node(AST(parser), NODE_POSTFIX, parser->previous, left, 0);
 }
 
-static void parse_binary(Parser* parser, bool can_assign)
+static NodeIndex parse_binary(Parser* parser, NodeIndex left, bool can_assign)
 {
-  AstNode* left_node = ALLOC_NODE(parser);
-  memcpy(left_node, parser->node, sizeof(AstNode));
-  memset(parser->node, 0, sizeof(AstNode));
-  parser->node->type         = NODE_BINARY;
-  parser->node->binary.left  = left_node;
-  parser->node->binary.op    = parser->previous->type;
-  parser->node->binary.right = ALLOC_NODE(parser);
-  parser->node               = parser->node->binary.right;
-
-  parse_expression(parser, rules[parser->previous->type].precedence);
+  Token     op    = parser->previous;
+  NodeIndex right = parse_expression(parser, rules[op.type].precedence + 1);
+  return push_node(AST(parser), NODE_BINARY, op, left, right);
 }
 
-static void parse_constant(Parser* parser, bool can_assign)
+// the value stays in the constant table, the token indexes it
+static NodeIndex parse_constant(Parser* parser, bool can_assign)
 {
-  parser->node->type           = NODE_CONSTANT;
-  parser->node->constant.token = parser->previous;
+  NodeIndex node         = push_node(AST(parser), NODE_CONSTANT, parser->previous, 0, 0);
+
+  // already folded into the class of the value
+  TokenType current_type = CURRENT_TYPE(parser);
+  if (current_type >= TOKEN_UNSIGNED_POSTFIX && current_type <= TOKEN_FLOAT_POSTFIX)
+  {
+    advance(parser);
+  }
+  return node;
 }
 
-static void parse_expression(Parser* parser, Precedence precedence)
+static NodeIndex parse_expression(Parser* parser, Precedence precedence)
 {
+  TimeFunction;
   advance(parser);
-  ParseRule prefix = rules[parser->previous->type];
+  ParseRule prefix = rules[parser->previous.type];
   if (prefix.prefix == 0)
   {
-    error("Expected expression!");
+    error_at_token(parser->scanner, parser->previous, "Expected expression!");
   }
 
-  bool can_assign = precedence <= PREC_ASSIGNMENT;
+  bool      can_assign = precedence <= PREC_ASSIGNMENT;
 
-  prefix.prefix(parser, can_assign);
-  ParseRule current = rules[parser->current->type];
+  NodeIndex node       = prefix.prefix(parser, can_assign);
+  ParseRule current    = rules[parser->current.type];
 
   while (precedence <= current.precedence)
   {
     advance(parser);
-    current.infix(parser, can_assign);
-    current = rules[parser->current->type];
+    node    = current.infix(parser, node, can_assign);
+    current = rules[parser->current.type];
   }
 
-  if (can_assign && match(parser, TOKEN_EQUAL))
-  {
-    error("Can't assign to this!");
-  }
+  return node;
 }
 
-static void parse_return(Parser* parser)
+static NodeIndex parse_return(Parser* parser)
 {
-  parser->node->type          = NODE_RETURN;
-  parser->node->return_.value = ALLOC_NODE(parser);
-  parser->node                = parser->node->return_.value;
+  Token keyword = parser->current;
   advance(parser);
-  parse_expression(parser, PREC_ASSIGNMENT);
+  NodeIndex value = parse_expression(parser, PREC_ASSIGNMENT);
   consume(parser, TOKEN_SEMICOLON, "Expected ';' after return expression");
+  return push_node(AST(parser), NODE_RETURN, keyword, value, 0);
 }
 
 static bool is_declaration(Parser* parser)
@@ -434,320 +461,302 @@ static bool is_declaration(Parser* parser)
          current_type == TOKEN_DOUBLE || current_type == TOKEN_SIGNED || current_type == TOKEN_UNSIGNED || current_type == TOKEN_BOOL || current_type == TOKEN_COMPLEX;
 }
 
-static void parse_do(Parser* parser)
+static NodeIndex parse_do(Parser* parser)
 {
-  AstNode* do_node = parser->node;
-  do_node->type    = NODE_DO;
-
+  Token keyword = parser->current;
   advance(parser);
-  do_node->do_.body = ALLOC_NODE(parser);
-  parser->node      = do_node->do_.body;
-  parse_stmt(parser);
+  NodeIndex body = parse_stmt(parser);
 
   consume(parser, TOKEN_WHILE, "Expected while after do");
   consume(parser, TOKEN_LEFT_PAREN, "Expected '(' after while in do while");
-  do_node->do_.condition = ALLOC_NODE(parser);
-  parser->node           = do_node->do_.condition;
-
-  parse_expression(parser, PREC_ASSIGNMENT);
+  NodeIndex condition = parse_expression(parser, PREC_ASSIGNMENT);
   consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after while condition");
   consume(parser, TOKEN_SEMICOLON, "Expected ';' after do while");
+  return push_node(AST(parser), NODE_DO, keyword, condition, body);
 }
-static void parse_while(Parser* parser)
+static NodeIndex parse_while(Parser* parser)
 {
-
-  AstNode* while_node = parser->node;
-  while_node->type    = NODE_WHILE;
+  Token keyword = parser->current;
   advance(parser);
   consume(parser, TOKEN_LEFT_PAREN, "Expected '(' after for");
 
-  while_node->while_.condition = ALLOC_NODE(parser);
-  parser->node                 = while_node->while_.condition;
-  parse_expression(parser, PREC_ASSIGNMENT);
+  NodeIndex condition = parse_expression(parser, PREC_ASSIGNMENT);
   consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after while condition");
 
-  while_node->while_.body = ALLOC_NODE(parser);
-  parser->node            = while_node->while_.body;
-  parse_stmt(parser);
+  NodeIndex body = parse_stmt(parser);
+  return push_node(AST(parser), NODE_WHILE, keyword, condition, body);
 }
-static void parse_for(Parser* parser)
+static NodeIndex parse_for(Parser* parser)
 {
-  AstNode* for_node = parser->node;
-  for_node->type    = NODE_FOR;
-
+  Token keyword = parser->current;
   advance(parser);
   consume(parser, TOKEN_LEFT_PAREN, "Expected '(' after for");
 
-  for_node->for_.init = 0;
+  NodeIndex init = 0;
   if (is_declaration(parser))
   {
-    for_node->for_.init = ALLOC_NODE(parser);
-    parser->node        = for_node->for_.init;
-    parse_declaration(parser);
+    init = parse_declaration(parser);
   }
   else
   {
     consume(parser, TOKEN_SEMICOLON, "Expected ';' after first clause");
   }
 
-  for_node->for_.condition = 0;
+  NodeIndex condition = 0;
   if (!match(parser, TOKEN_SEMICOLON))
   {
-    for_node->for_.condition = ALLOC_NODE(parser);
-    parser->node             = for_node->for_.condition;
-    parse_expression(parser, PREC_ASSIGNMENT);
+    condition = parse_expression(parser, PREC_ASSIGNMENT);
     consume(parser, TOKEN_SEMICOLON, "Expected ';' after second expression");
   }
 
-  for_node->for_.update = 0;
+  NodeIndex update = 0;
   if (!match(parser, TOKEN_RIGHT_PAREN))
   {
-    for_node->for_.update = ALLOC_NODE(parser);
-    parser->node          = for_node->for_.update;
-    parse_expression(parser, PREC_ASSIGNMENT);
+    update = parse_expression(parser, PREC_ASSIGNMENT);
     consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after third expression");
   }
 
-  for_node->for_.body = ALLOC_NODE(parser);
-  parser->node        = for_node->for_.body;
-  parse_stmt(parser);
-}
-static void parse_typedef(Parser* parser)
-{
-  // struct union enum
+  NodeIndex body    = parse_stmt(parser);
+  u32       clauses = push_extra(AST(parser), init);
+  push_extra(AST(parser), condition);
+  push_extra(AST(parser), update);
+  push_extra(AST(parser), body);
+  return push_node(AST(parser), NODE_FOR, keyword, clauses, 0);
 }
-
 static bool is_int_constant(Parser* parser)
 {
   TokenType current_type = CURRENT_TYPE(parser);
   return (current_type == TOKEN_INT_CONSTANT || current_type == TOKEN_INT_HEX_CONSTANT || current_type == TOKEN_OCTAL_CONSTANT);
 }
 
-static void parse_enum(Parser* parser)
+static NodeIndex parse_enum(Parser* parser)
 {
-  AstNode* node       = parser->node;
-  node->type          = NODE_ENUM;
-  EnumNode* enum_node = &node->enum_;
   advance(parser);
 
   consume(parser, TOKEN_IDENTIFIER, "Expected enum name");
-  enum_node->name = &parser->previous->literal;
+  Token name = parser->previous;
+  declare_symbol(&parser->symbols, name.value, SYMBOL_ENUM);
 
   consume(parser, TOKEN_LEFT_BRACE, "Expected '{' after enum");
   if (match(parser, TOKEN_RIGHT_BRACE))
   {
-    error("No empty enum");
+    parse_error(parser, "No empty enum");
   }
 
-  enum_node->values = ALLOC(parser, EnumValue);
-  EnumValue* value  = enum_node->values;
-  while (true)
+  u32 values = parser->stack_count;
+  do
   {
     consume(parser, TOKEN_IDENTIFIER, "Expected identifier for enum");
-    value->name     = &parser->previous->literal;
-    value->constant = 0;
+    Token     value    = parser->previous;
+    NodeIndex constant = 0;
     if (match(parser, TOKEN_EQUAL))
     {
       if (!(is_int_constant(parser) || CURRENT_TYPE(parser) == TOKEN_IDENTIFIER))
       {
-        error("Enum value needs to be int constant or enum value");
+        parse_error(parser, "Enum value needs to be int constant or enum value");
       }
       advance(parser);
-      value->constant = parser->previous;
-    }
-    if (match(parser, TOKEN_COMMA))
-    {
-      value->next = ALLOC(parser, EnumValue);
-      value       = value->next;
+      constant = push_node(AST(parser), parser->previous.type == TOKEN_IDENTIFIER ? NODE_IDENTIFIER : NODE_CONSTANT, parser->previous, 0, 0);
     }
-    else
-    {
-      break;
-    }
-  }
+    push_child(parser, push_node(AST(parser), NODE_ENUM_VALUE, value, constant, 0));
+  } while (match(parser, TOKEN_COMMA));
 
   consume(parser, TOKEN_RIGHT_BRACE, "Need to close enum?");
-  consume(parser, TOKEN_SEMICOLON, "Need to close enum?");
+  return push_node(AST(parser), NODE_ENUM, name, end_list(parser, values), 0);
 }
 
-static void parse_fields(Parser* parser, StructField** field_ptr)
+static u32 parse_fields(Parser* parser)
 {
-  StructField* field = 0;
-  if (!match(parser, TOKEN_RIGHT_BRACE))
+  u32 fields = parser->stack_count;
+  while (!match(parser, TOKEN_RIGHT_BRACE))
   {
-
-    do
+    if (!(is_declaration(parser)))
     {
-      if (field == 0)
-      {
-        *field_ptr = ALLOC(parser, StructField);
-        field      = *field_ptr;
-      }
-      else
-      {
-        field->next = ALLOC(parser, StructField);
-        field       = field->next;
-      }
-
-      if (!(is_declaration(parser)))
-      {
-        error("Not struct or type?");
-      }
-      field->type = parse_data_type(parser);
-      consume(parser, TOKEN_IDENTIFIER, "Expected field name");
-      field->name = &parser->previous->literal;
-      consume(parser, TOKEN_SEMICOLON, "Expected ';' after field");
-
-    } while (!match(parser, TOKEN_RIGHT_BRACE));
+      parse_error(parser, "Not struct or type?");
+    }
+    u32 type = push_type(AST(parser), parse_data_type(parser));
+    consume(parser, TOKEN_IDENTIFIER, "Expected field name");
+    push_child(parser, push_node(AST(parser), NODE_FIELD, parser->previous, type, 0));
+    consume(parser, TOKEN_SEMICOLON, "Expected ';' after field");
   }
+  return end_list(parser, fields);
 }
 
-static void parse_struct(Parser* parser)
+// struct and union only differ in the kind
+static NodeIndex parse_struct(Parser* parser, AstNodeType kind)
 {
-  AstNode* node = parser->node;
-  node->type    = NODE_STRUCT;
   advance(parser);
   // ToDo should be if
   consume(parser, TOKEN_IDENTIFIER, "Expected struct name");
-  node->struct_.name = &parser->previous->literal;
+  Token name = parser->previous;
+  // before the fields so they can point to it
+  declare_symbol(&parser->symbols, name.value, kind == NODE_STRUCT ? SYMBOL_STRUCT : SYMBOL_UNION);
   consume(parser, TOKEN_LEFT_BRACE, "Expected '{' after struct name");
 
-  parse_fields(parser, &node->struct_.fields);
-  consume(parser, TOKEN_SEMICOLON, "Expected '}' after struct declaration");
+  u32 fields = parse_fields(parser);
+  return push_node(AST(parser), kind, name, fields, 0);
+}
+
+// struct, union or enum up to the closing brace, what follows is up to the caller
+static NodeIndex parse_definition(Parser* parser)
+{
+  switch (CURRENT_TYPE(parser))
+  {
+  case TOKEN_ENUM:
+  {
+    return parse_enum(parser);
+  }
+  case TOKEN_UNION:
+  {
+    return parse_struct(parser, NODE_UNION);
+  }
+  default:
+  {
+    return parse_struct(parser, NODE_STRUCT);
+  }
+  }
 }
-static void parse_union(Parser* parser)
+
+static NodeIndex parse_typedef(Parser* parser)
 {
-  AstNode* node = parser->node;
-  node->type    = NODE_UNION;
   advance(parser);
-  // ToDo should be if
-  consume(parser, TOKEN_IDENTIFIER, "Expected struct name");
-  node->union_.name = &parser->previous->literal;
-  consume(parser, TOKEN_LEFT_BRACE, "Expected '{' after struct name");
-  parse_fields(parser, &node->union_.fields);
-  consume(parser, TOKEN_SEMICOLON, "Expected '}' after struct declaration");
+  DataType  type         = {};
+  NodeIndex definition   = 0;
+  TokenType current_type = CURRENT_TYPE(parser);
+  if (current_type == TOKEN_STRUCT || current_type == TOKEN_UNION || current_type == TOKEN_ENUM)
+  {
+    definition         = parse_definition(parser);
+    type.type          = DATA_TYPE_STRUCT;
+    type.strukt.symbol = AST(parser)->tokens[definition].value;
+    while (match(parser, TOKEN_STAR))
+    {
+      type.depth++;
+    }
+  }
+  else
+  {
+    type = parse_data_type(parser);
+  }
+
+  consume(parser, TOKEN_IDENTIFIER, "Expected typedef name");
+  Token name = parser->previous;
+  declare_symbol(&parser->symbols, name.value, SYMBOL_TYPEDEF);
+  consume(parser, TOKEN_SEMICOLON, "Expected ';' after typedef");
+  return push_node(AST(parser), NODE_TYPEDEF, name, push_type(AST(parser), type), definition);
 }
 
-static void parse_if_block(Parser* parser, IfBlock* block)
+static void parse_if_block(Parser* parser)
 {
   consume(parser, TOKEN_LEFT_PAREN, "Expected '(' for if condition");
-  block->condition = ALLOC_NODE(parser);
-  parser->node     = block->condition;
-
-  parse_expression(parser, PREC_ASSIGNMENT);
+  push_child(parser, parse_expression(parser, PREC_ASSIGNMENT));
   consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after if condition");
-  block->body  = ALLOC_NODE(parser);
-  parser->node = block->body;
-  parse_stmt(parser);
+  push_child(parser, parse_stmt(parser));
 }
 
-static void parse_if(Parser* parser)
+static NodeIndex parse_if(Parser* parser)
 {
-
-  AstNode* node    = parser->node;
-  node->type       = NODE_IF;
-  node->if_.blocks = ALLOC(parser, IfBlock);
-  IfBlock* blocks  = node->if_.blocks;
+  Token keyword = parser->current;
+  u32   blocks  = parser->stack_count;
   advance(parser);
-  parse_if_block(parser, blocks);
+  parse_if_block(parser);
 
+  NodeIndex else_ = 0;
   while (match(parser, TOKEN_ELSE))
   {
     if (match(parser, TOKEN_IF))
     {
-      blocks->next = ALLOC(parser, IfBlock);
-      blocks       = blocks->next;
-      parse_if_block(parser, blocks);
+      parse_if_block(parser);
     }
     else
     {
-      node->if_.else_ = ALLOC_NODE(parser);
-      parser->node    = node->if_.else_;
-      parse_stmt(parser);
+      else_ = parse_stmt(parser);
       break;
     }
   }
+  return push_node(AST(parser), NODE_IF, keyword, end_list(parser, blocks), else_);
 }
 
-static void parse_switch(Parser* parser)
+static NodeIndex parse_switch(Parser* parser)
 {
+  Token keyword = parser->current;
   advance(parser);
   consume(parser, TOKEN_LEFT_PAREN, "Expect '(' after switch");
-  AstNode* node           = parser->node;
-  node->type              = NODE_SWITCH;
-  node->switch_.condition = ALLOC_NODE(parser);
-
-  parser->node            = node->switch_.condition;
-  parse_expression(parser, PREC_ASSIGNMENT);
+  NodeIndex condition = parse_expression(parser, PREC_ASSIGNMENT);
   consume(parser, TOKEN_RIGHT_PAREN, "Expect ')' after switch condition");
-  node->switch_.block = ALLOC_NODE(parser);
-  parser->node        = node->switch_.block;
-  parse_stmt(parser);
+  NodeIndex body = parse_stmt(parser);
+  return push_node(AST(parser), NODE_SWITCH, keyword, condition, body);
 }
 
-static void parse_case(Parser* parser)
+static NodeIndex parse_case(Parser* parser)
 {
   advance(parser);
+  return push_node(AST(parser), NODE_EMPTY, parser->previous, 0, 0);
 }
 
-static void parse_default(Parser* parser)
+static NodeIndex parse_default(Parser* parser)
 {
   advance(parser);
+  return push_node(AST(parser), NODE_EMPTY, parser->previous, 0, 0);
+}
+
+/*
+  a = b = c assigns right to left, the value is parsed at the precedence
+  of the '=' itself so it takes the next assignment instead of stopping
+  before it. Only an expression that names something can be assigned to.
+*/
+static NodeIndex parse_assignment(Parser* parser, NodeIndex target, bool can_assign)
+{
+  Token       op   = parser->previous;
+  AstNodeType kind = AST(parser)->kinds[target];
+  if (!can_assign || !(kind == NODE_IDENTIFIER || kind == NODE_INDEX || kind == NODE_DOT || kind == NODE_UNARY))
+  {
+    error_at_token(parser->scanner, op, "Can't assign to this!");
+  }
+  NodeIndex value = parse_expression(parser, PREC_ASSIGNMENT);
+  return push_node(AST(parser), NODE_ASSIGN, op, target, value);
 }
 
-static void parse_stmt(Parser* parser)
+static NodeIndex parse_stmt(Parser* parser)
 {
+  TimeFunction;
   switch (CURRENT_TYPE(parser))
   {
   case TOKEN_IF:
   {
-    parse_if(parser);
-    break;
+    return parse_if(parser);
   }
   case TOKEN_CASE:
   {
-    parse_case(parser);
-    break;
+    return parse_case(parser);
   }
   case TOKEN_DEFAULT:
   {
-    parse_default(parser);
-    break;
+    return parse_default(parser);
   }
   case TOKEN_SWITCH:
   {
-    parse_switch(parser);
-    break;
+    return parse_switch(parser);
   }
   case TOKEN_ENUM:
-  {
-    parse_enum(parser);
-    break;
-  }
   case TOKEN_STRUCT:
+  case TOKEN_UNION:
   {
-    parse_struct(parser);
-    break;
+    NodeIndex node = parse_definition(parser);
+    consume(parser, TOKEN_SEMICOLON, "Expected ';' after definition");
+    return node;
   }
   case TOKEN_TYPEDEF:
   {
-    parse_typedef(parser);
-  }
-  case TOKEN_UNION:
-  {
-    parse_union(parser);
-    break;
+    return parse_typedef(parser);
   }
   case TOKEN_LEFT_BRACE:
   {
     advance(parser);
-    parse_block(parser);
-    return;
+    return parse_block(parser);
   }
   case TOKEN_WHILE:
   {
-    parse_while(parser);
-    return;
+    return parse_while(parser);
   }
   case TOKEN_BREAK:
   {
@@ -759,18 +768,15 @@ static void parse_stmt(Parser* parser)
   }
   case TOKEN_DO:
   {
-    parse_do(parser);
-    return;
+    return parse_do(parser);
   }
   case TOKEN_FOR:
   {
-    parse_for(parser);
-    return;
+    return parse_for(parser);
   }
   case TOKEN_RETURN:
   {
-    parse_return(parser);
-    return;
+    return parse_return(parser);
   }
 
     // parse some type
@@ -787,15 +793,13 @@ static void parse_stmt(Parser* parser)
   case TOKEN_LONG:
   case TOKEN_SHORT:
   {
-    parse_declaration(parser);
-    break;
+    return parse_declaration(parser);
   }
 
   case TOKEN_SEMICOLON:
   {
-    parser->node->type = NODE_EMPTY;
-    break;
-    // just empty?
+    advance(parser);
+    return push_node(AST(parser), NODE_EMPTY, parser->previous, 0, 0);
   }
   // ToDo fix function pointer?
   case TOKEN_LEFT_PAREN:
@@ -803,88 +807,52 @@ static void parse_stmt(Parser* parser)
   {
     if (is_struct(parser))
     {
-      parse_declaration(parser);
-    }
-    else
-    {
-      // evaluate the expression
-      // while right side assign
-      AstNode* prev = parser->node;
-      parse_expression(parser, PREC_ASSIGNMENT + 1);
-      while (match(parser, TOKEN_EQUAL))
-      {
-        AstNode* node = ALLOC_NODE(parser);
-        AstNode  tmp  = *prev;
-        memset(prev, 0, sizeof(AstNode));
-        parser->node         = node;
-        prev->type           = NODE_ASSIGN;
-
-        prev->assign.target  = ALLOC_NODE(parser);
-        *prev->assign.target = tmp;
-        prev->assign.value   = node;
-        parse_expression(parser, PREC_ASSIGNMENT + 1);
-        prev = node;
-      }
-
-      consume(parser, TOKEN_SEMICOLON, "Expected ';' after expression stmt?");
+      return parse_declaration(parser);
     }
-    break;
+    NodeIndex node = parse_expression(parser, PREC_ASSIGNMENT);
+    consume(parser, TOKEN_SEMICOLON, "Expected ';' after expression stmt?");
+    return node;
   }
 
   case TOKEN_EOF:
   default:
   {
-    error("idk can't parse this");
+    parse_error(parser, "idk can't parse this");
+    return 0;
   }
   }
 }
 
-static void parse_block(Parser* parser)
+// after the '{'
+static NodeIndex parse_block(Parser* parser)
 {
-  parser->node->type = NODE_BLOCK;
-  AstNode* curr      = 0;
+  Token brace      = parser->previous;
+  u32   statements = parser->stack_count;
+  push_scope(&parser->symbols);
   while (!match(parser, TOKEN_RIGHT_BRACE))
   {
-    if (curr == 0)
-    {
-      parser->node->block.nodes = ALLOC_NODE(parser);
-      curr                      = parser->node->block.nodes;
-      curr->next                = 0;
-    }
-    else
-    {
-      curr->next = ALLOC_NODE(parser);
-      curr       = curr->next;
-    }
-    parser->node = curr;
-    parse_stmt(parser);
+    push_child(parser, parse_stmt(parser));
   }
+  pop_scope(&parser->symbols);
+  return push_node(AST(parser), NODE_BLOCK, brace, end_list(parser, statements), 0);
 }
 
-static void parse_function(Parser* parser, DataType type, String* literal)
+static NodeIndex parse_function(Parser* parser, DataType type, Token name)
 {
-  FunctionNode* node   = &parser->node->function;
-  parser->node->type   = NODE_FUNCTION;
-
-  node->return_type    = type;
-  node->name           = literal;
-  node->argument_count = 0;
-  node->arguments      = 0;
+  u32 parameters = parser->stack_count;
   if (!match(parser, TOKEN_RIGHT_PAREN))
   {
-    node->arguments = (Argument*)(parser->scanner->arena->ptr + parser->scanner->arena->memory);
     do
     {
-      (void)ALLOC(parser, Argument);
-
-      node->arguments[node->argument_count].type = parse_data_type(parser);
+      u32 parameter_type = push_type(AST(parser), parse_data_type(parser));
       consume(parser, TOKEN_IDENTIFIER, "Expected argument name?");
-      node->arguments[node->argument_count].name = &parser->previous->literal;
-      node->argument_count++;
+      push_child(parser, push_node(AST(parser), NODE_PARAMETER, parser->previous, parameter_type, 0));
 
     } while (match(parser, TOKEN_COMMA));
     consume(parser, TOKEN_RIGHT_PAREN, "Expected ')' after function params");
   }
+
+  NodeIndex block = 0;
   if (match(parser, TOKEN_SEMICOLON))
   {
     // only declared it
@@ -892,17 +860,20 @@ static void parse_function(Parser* parser, DataType type, String* literal)
   else
   {
     consume(parser, TOKEN_LEFT_BRACE, "Expected '{' or ';' after function params");
-    node->block  = ALLOC_NODE(parser);
-    parser->node = node->block;
-    parse_block(parser);
+    block = parse_block(parser);
   }
+  u32 extra = push_extra(AST(parser), block);
+  end_list(parser, parameters);
+  return push_node(AST(parser), NODE_FUNCTION, name, push_type(AST(parser), type), extra);
 }
 
-static void parse_declaration(Parser* parser)
+static NodeIndex parse_declaration(Parser* parser)
 {
+  TimeFunction;
+  Token    start             = parser->current;
 
   DataType type;
-  String*  name              = 0;
+  Token    name              = {};
   char     storage_specifier = 0;
   char     type_qualifier    = 0;
   bool     got_type          = false;
@@ -918,7 +889,7 @@ static void parse_declaration(Parser* parser)
     {
       if (storage_specifier != 0)
       {
-        error("Already declared this storage qualifier");
+        parse_error(parser, "Already declared this storage qualifier");
       }
       storage_specifier |= get_storage_specifier(CURRENT_TYPE(parser));
       advance(parser);
@@ -931,7 +902,7 @@ static void parse_declaration(Parser* parser)
     {
       if ((type_qualifier & get_type_qualifier(CURRENT_TYPE(parser))) != 0)
       {
-        error("Already declared this type qualifier");
+        parse_error(parser, "Already declared this type qualifier");
       }
       type_qualifier |= get_type_qualifier(CURRENT_TYPE(parser));
       advance(parser);
@@ -944,7 +915,7 @@ static void parse_declaration(Parser* parser)
       {
         if (got_type)
         {
-          error("Already got type");
+          parse_error(parser, "Already got type");
         }
         got_type = true;
         type     = parse_data_type(parser);
@@ -952,8 +923,8 @@ static void parse_declaration(Parser* parser)
       else
       {
         got_identifier = true;
-        name           = &parser->current->literal;
         advance(parser);
+        name = parser->previous;
       }
       break;
     }
@@ -971,7 +942,7 @@ static void parse_declaration(Parser* parser)
     {
       if (got_type)
       {
-        error("Already got type");
+        parse_error(parser, "Already got type");
       }
       got_type = true;
       type     = parse_data_type(parser);
@@ -979,7 +950,7 @@ static void parse_declaration(Parser* parser)
     }
     default:
     {
-      error("Huh?");
+      parse_error(parser, "Huh?");
     }
     }
   }
@@ -988,46 +959,37 @@ static void parse_declaration(Parser* parser)
   {
     if (type_qualifier != 0 || storage_specifier != 0)
     {
-      error("Can't declare a function with type/storage specifiers");
+      parse_error(parser, "Can't declare a function with type/storage specifiers");
     }
-    parse_function(parser, type, name);
-  }
-  else
-  {
-    variable_declaration(parser, type, name, type_qualifier, storage_specifier);
+    return parse_function(parser, type, name);
   }
+  return variable_declaration(parser, start, type, name, type_qualifier, storage_specifier);
 }
 
-AstNode* parse(Parser* parser)
+Ast* parse(Parser* parser)
 {
-  AstNode* out  = ALLOC_NODE(parser);
-  AstNode* last = out;
+  u32 declarations = parser->stack_count;
+  push_scope(&parser->symbols);
   advance(parser);
   while (!is_at_end(parser))
   {
-    parser->node = last;
-
+    NodeIndex node = 0;
     switch (CURRENT_TYPE(parser))
     {
     case TOKEN_INLINE:
     {
     }
     case TOKEN_ENUM:
-    {
-      parse_enum(parser);
-      break;
-    }
     case TOKEN_STRUCT:
+    case TOKEN_UNION:
     {
-      parse_struct(parser);
+      node = parse_definition(parser);
+      consume(parser, TOKEN_SEMICOLON, "Expected ';' after definition");
       break;
     }
     case TOKEN_TYPEDEF:
     {
-    }
-    case TOKEN_UNION:
-    {
-      parse_union(parser);
+      node = parse_typedef(parser);
       break;
     }
 
@@ -1045,7 +1007,7 @@ AstNode* parse(Parser* parser)
     case TOKEN_SHORT:
     case TOKEN_VOID:
     {
-      parse_declaration(parser);
+      node = parse_declaration(parser);
       break;
     }
 
@@ -1056,19 +1018,20 @@ AstNode* parse(Parser* parser)
 
     case TOKEN_SEMICOLON:
     {
-      parser->node->type = NODE_EMPTY;
+      advance(parser);
+      node = push_node(AST(parser), NODE_EMPTY, parser->previous, 0, 0);
       break;
     }
     case TOKEN_IDENTIFIER:
     {
       if (is_struct(parser))
       {
-        parse_declaration(parser);
+        node = parse_declaration(parser);
         break;
       }
       else
       {
-        error("Expected type or smth?");
+        parse_error(parser, "Expected type or smth?");
       }
       // should be type?
     }
@@ -1078,15 +1041,18 @@ AstNode* parse(Parser* parser)
     }
     default:
     {
-      error("idk can't parse this");
-    }
+      parse_error(parser, "idk can't parse this");
     }
-
-    if (!is_at_end(parser))
-    {
-      last->next = ALLOC_NODE(parser);
-      last       = last->next;
     }
+    push_child(parser, node);
   }
-  return out;
+  AST(parser)->root = end_list(parser, declarations);
+  pop_scope(&parser->symbols);
+  return AST(parser);
+}
+
+// the tree is in the scanner's arena and outlives the parser
+void free_parser(Parser* parser)
+{
+  sta_arena_free(&parser->symbol_arena);
 }
@@ -5,6 +5,7 @@
 #include "common.h"
 #include "precedence.h"
 #include "scanner.h"
+#include "symbol_table.h"
 #include "token.h"
 
 typedef enum
@@ -24,22 +25,31 @@ typedef enum
 
 typedef struct
 {
-  Token*   current;
-  Token*   previous;
-  AstNode* node;
-  Scanner* scanner;
+  Token        current;
+  Token        previous;
+  Ast          ast;
+  Scanner*     scanner;
+  TokenBuffer* tokens;
+  u32          token_index;
+  u32*         stack; // entries of the lists still being parsed
+  u32          stack_count;
+  u32          stack_capacity;
+  SymbolTable  symbols; // the type names in scope
+  Arena        symbol_arena; // owned, the scopes point into it so the parser stays put
 } Parser;
 
-typedef void (*ParseFn)(Parser* parser, bool canAssign);
+typedef NodeIndex (*PrefixFn)(Parser* parser, bool canAssign);
+typedef NodeIndex (*InfixFn)(Parser* parser, NodeIndex left, bool canAssign);
 
 typedef struct
 {
-  ParseFn    prefix;
-  ParseFn    infix;
+  PrefixFn   prefix;
+  InfixFn    infix;
   Precedence precedence;
 } ParseRule;
 
-void     init_parser(Parser* parser, Scanner* scanner);
-AstNode* parse(Parser* parser);
+void     init_parser(Parser* parser, Scanner* scanner, TokenBuffer* tokens);
+Ast*     parse(Parser* parser);
+void     free_parser(Parser* parser);
 
 #endif
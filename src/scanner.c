@@ -1,12 +1,24 @@
 
 #include "scanner.h"
 #include "common.h"
+#include "decimal.h"
 #include "stdbool.h"
 #include "token.h"
-#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+static void init_skip_functions(void);
+// the dispatch is picked once, the scanners of parallel workers are made at the same time
+static pthread_once_t skip_functions_once = PTHREAD_ONCE_INIT;
+static void error_at(Scanner* scanner, i32 index, const char* message);
+static bool refill_stream(Scanner* scanner);
+static void find_line_starts(LineTable* lines, Arena* arena, String* bytes, u32 base);
+static void init_line_table(LineTable* lines, Arena* arena);
 
 void error(const char* message)
 {
@@ -18,25 +30,109 @@ void init_scanner(Scanner* scanner, Arena* arena, String* literal, const char* f
 {
   scanner->filename = (u8*)filename;
   scanner->index    = 0;
-  scanner->line     = 1;
   scanner->input    = literal;
   scanner->arena    = arena;
+  scanner->lines    = (LineTable){};
+  scanner->symbols      = (InternTable){};
+  scanner->constants    = (ConstantTable){};
+  scanner->strings      = (StringTable){};
+  scanner->suffix_start = -1;
+  scanner->base         = 0;
+  scanner->stream       = 0;
+  pthread_once(&skip_functions_once, init_skip_functions);
+}
+
+/*
+  Reads the input through a window of window_size bytes instead of holding
+  it whole. Everything kept past the next refill is copied out of the window
+  into the arena: symbol names, constant literals and string contents. Line
+  starts are recorded as bytes come in since the text is gone afterwards.
+*/
+void init_stream_scanner(Scanner* scanner, Arena* arena, i32 fd, u64 window_size, const char* filename)
+{
+  Stream* stream        = sta_arena_push_struct(arena, Stream);
+  stream->window.buffer = sta_arena_push_array(arena, char, window_size + 1);
+  stream->window.len    = 0;
+  stream->capacity      = window_size;
+  stream->fd            = fd;
+  stream->eof           = false;
+
+  init_scanner(scanner, arena, &stream->window, filename);
+  scanner->stream             = stream;
+  scanner->symbols.copy_names = true;
+  init_line_table(&scanner->lines, arena);
+  refill_stream(scanner);
 }
 
-static bool match_substring(Scanner* scanner, const char* to_match, int length)
+// tops the window up once less than half of it is left unread, the unread
+// bytes move to the front so index and base change together. False when
+// there was nothing to do
+static bool refill_stream(Scanner* scanner)
 {
-  String* literal = scanner->input;
-  if (literal->len <= scanner->index + length)
+  Stream* stream = scanner->stream;
+  String* window = &stream->window;
+  u64     ahead  = window->len - scanner->index;
+  if (stream->eof || ahead >= stream->capacity / 2)
   {
     return false;
   }
-  if (strncmp(&literal->buffer[scanner->index], to_match, length) == 0)
+  TimeBandwidth(reading, stream->capacity - ahead);
+
+  memmove(window->buffer, &window->buffer[scanner->index], ahead);
+  scanner->base += scanner->index;
+  scanner->suffix_start -= scanner->index;
+  scanner->index = 0;
+  window->len    = ahead;
+  while (window->len < stream->capacity)
+  {
+    ssize_t count = read(stream->fd, &window->buffer[window->len], stream->capacity - window->len);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      error("Couldn't read input!");
+    }
+    if (count == 0)
+    {
+      stream->eof = true;
+      break;
+    }
+    window->len += count;
+  }
+  window->buffer[window->len] = 0;
+  // token offsets are 32 bits
+  if ((u64)scanner->base + window->len > UINT32_MAX)
   {
-    scanner->index += length;
+    error("Input is larger than 4GB!");
   }
-  return false;
+
+  String fresh = {.buffer = &window->buffer[ahead], .len = window->len - ahead};
+  find_line_starts(&scanner->lines, scanner->arena, &fresh, scanner->base + ahead);
+  ExitBlock(reading);
+  return true;
 }
 
+// slices of the window are overwritten by the next refill
+static String keep_literal(Scanner* scanner, String literal)
+{
+  if (scanner->stream)
+  {
+    String copy = {};
+    sta_strcpy(scanner->arena, &copy, &literal);
+    return copy;
+  }
+  return literal;
+}
+
+/*
+  The byte after an input is always there: a 0 past a whole file or a
+  stream window, and the newline that starts the next chunk when lexing in
+  parallel. Loops that stop on both never need the length. The checks left
+  are for blanks, which a newline is, for string bytes, where skipping an
+  escape can step over the 0, and once per token or string piece.
+*/
 static bool is_out_of_bounds(Scanner* scanner)
 {
   return scanner->input->len <= scanner->index;
@@ -54,6 +150,7 @@ static u8 advance(Scanner* scanner)
   return out;
 }
 
+// never called with 0 or a newline
 static bool match_next(Scanner* scanner, char toMatch)
 {
   if (current_char(scanner) == toMatch)
@@ -64,558 +161,1758 @@ static bool match_next(Scanner* scanner, char toMatch)
   return false;
 }
 
-static void skip_whitespace(Scanner* scanner)
+/*
+  Every byte maps to the class that decides which lexer routine handles a
+  token starting with it, plus flags used by the loops that extend a token.
+  Bytes of CLASS_NONE never start a token and are skipped as whitespace.
+*/
+typedef enum
 {
+  CLASS_NONE,
+  CLASS_IDENTIFIER,
+  CLASS_DIGIT,
+  CLASS_PUNCTUATOR,
+  CLASS_OPERATOR,
+  CLASS_DOT,
+  CLASS_STRING,
+  CLASS_CHARACTER,
+  CLASS_POUND,
+  CLASS_COUNT
+} CharClass;
 
-  while (true)
+typedef enum
+{
+  FLAG_BLANK      = 1,
+  FLAG_IDENTIFIER = 2,
+  FLAG_DIGIT      = 4,
+  FLAG_HEX        = 8,
+  FLAG_OCTAL      = 16,
+  FLAG_BINARY     = 32,
+} CharFlag;
+
+typedef struct
+{
+  u8 class;
+  u8 flags;
+} CharInfo;
+
+#define IDENTIFIER_CHAR {CLASS_IDENTIFIER, FLAG_IDENTIFIER}
+#define HEX_LETTER      {CLASS_IDENTIFIER, FLAG_IDENTIFIER | FLAG_HEX}
+
+static const CharInfo char_info[256] = {
+    [' ']         = {CLASS_NONE, FLAG_BLANK},
+    ['\t' ... '\r'] = {CLASS_NONE, FLAG_BLANK},
+    ['0' ... '1'] = {CLASS_DIGIT, FLAG_IDENTIFIER | FLAG_DIGIT | FLAG_HEX | FLAG_OCTAL | FLAG_BINARY},
+    ['2' ... '7'] = {CLASS_DIGIT, FLAG_IDENTIFIER | FLAG_DIGIT | FLAG_HEX | FLAG_OCTAL},
+    ['8' ... '9'] = {CLASS_DIGIT, FLAG_IDENTIFIER | FLAG_DIGIT | FLAG_HEX},
+    ['a' ... 'f'] = HEX_LETTER,
+    ['A' ... 'F'] = HEX_LETTER,
+    ['g' ... 'z'] = IDENTIFIER_CHAR,
+    ['G' ... 'Z'] = IDENTIFIER_CHAR,
+    ['_']         = IDENTIFIER_CHAR,
+    ['{']         = {CLASS_PUNCTUATOR},
+    ['}']         = {CLASS_PUNCTUATOR},
+    ['[']         = {CLASS_PUNCTUATOR},
+    [']']         = {CLASS_PUNCTUATOR},
+    ['(']         = {CLASS_PUNCTUATOR},
+    [')']         = {CLASS_PUNCTUATOR},
+    [';']         = {CLASS_PUNCTUATOR},
+    [':']         = {CLASS_PUNCTUATOR},
+    [',']         = {CLASS_PUNCTUATOR},
+    ['%']         = {CLASS_PUNCTUATOR},
+    ['^']         = {CLASS_PUNCTUATOR},
+    ['*']         = {CLASS_PUNCTUATOR},
+    ['/']         = {CLASS_PUNCTUATOR},
+    ['&']         = {CLASS_OPERATOR},
+    ['|']         = {CLASS_OPERATOR},
+    ['!']         = {CLASS_OPERATOR},
+    ['<']         = {CLASS_OPERATOR},
+    ['>']         = {CLASS_OPERATOR},
+    ['-']         = {CLASS_OPERATOR},
+    ['+']         = {CLASS_OPERATOR},
+    ['=']         = {CLASS_OPERATOR},
+    ['.']         = {CLASS_DOT},
+    ['\"']        = {CLASS_STRING},
+    ['\'']        = {CLASS_CHARACTER},
+    ['#']         = {CLASS_POUND},
+};
+
+#undef IDENTIFIER_CHAR
+#undef HEX_LETTER
+
+static const TokenType punctuators[256] = {
+    ['{'] = TOKEN_LEFT_BRACE,  ['}'] = TOKEN_RIGHT_BRACE, ['['] = TOKEN_LEFT_BRACKET, [']'] = TOKEN_RIGHT_BRACKET, ['('] = TOKEN_LEFT_PAREN, [')'] = TOKEN_RIGHT_PAREN,
+    [';'] = TOKEN_SEMICOLON,   [':'] = TOKEN_COLON,       [','] = TOKEN_COMMA,        ['%'] = TOKEN_MOD,           ['^'] = TOKEN_XOR,        ['*'] = TOKEN_STAR,
+    ['/'] = TOKEN_SLASH,
+};
+
+// operators that become a different token when followed by one of two bytes,
+// unused slots of next are 0
+typedef struct
+{
+  TokenType single;
+  u8        next[2];
+  TokenType pair[2];
+} Operator;
+
+static const Operator operators[256] = {
+    ['&'] = {TOKEN_AND_BIT, {'&'}, {TOKEN_AND_LOGICAL}},
+    ['|'] = {TOKEN_OR_BIT, {'|'}, {TOKEN_OR_LOGICAL}},
+    ['!'] = {TOKEN_BANG, {'='}, {TOKEN_BANG_EQUAL}},
+    ['<'] = {TOKEN_LESS, {'=', '<'}, {TOKEN_LESS_EQUAL, TOKEN_SHIFT_LEFT}},
+    ['>'] = {TOKEN_GREATER, {'=', '>'}, {TOKEN_GREATER_EQUAL, TOKEN_SHIFT_RIGHT}},
+    ['-'] = {TOKEN_MINUS, {'-'}, {TOKEN_DECREMENT}},
+    ['+'] = {TOKEN_PLUS, {'+'}, {TOKEN_INCREMENT}},
+    ['='] = {TOKEN_EQUAL, {'='}, {TOKEN_EQUAL_EQUAL}},
+};
+
+static inline bool is_blank(u8 c)
+{
+  return char_info[c].flags & FLAG_BLANK;
+}
+
+// digits only, neither 0 nor a newline has them
+static inline bool has_flag(Scanner* scanner, CharFlag flag)
+{
+  return char_info[(u8)current_char(scanner)].flags & flag;
+}
+
+// no bounds check, the byte after the input has no flags this is called with
+static void skip_while(Scanner* scanner, CharFlag flag)
+{
+  while (char_info[(u8)current_char(scanner)].flags & flag)
   {
-    if (is_out_of_bounds(scanner))
+    scanner->index++;
+  }
+}
+
+static u8 digit_value(u8 c)
+{
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static void push_line_start(LineTable* lines, Arena* arena, u32 offset)
+{
+  if (lines->count == lines->capacity)
+  {
+    u32* starts = sta_arena_push_array_tagged(arena, u32, lines->capacity * 2, "LineTable");
+    memcpy(starts, lines->starts, lines->count * sizeof(u32));
+    lines->starts = starts;
+    lines->capacity *= 2;
+  }
+  lines->starts[lines->count++] = offset;
+}
+
+/*
+  Scalar versions, used on machines without SSE2 and for the tail of the input
+  where a full vector load would read past the end of the buffer.
+*/
+
+static void skip_blank_scalar(Scanner* scanner)
+{
+  while (!is_out_of_bounds(scanner) && is_blank(current_char(scanner)))
+  {
+    advance(scanner);
+  }
+}
+
+// the length is only looked at for a 0, which is the end or a stray byte
+static void skip_line_comment_scalar(Scanner* scanner)
+{
+  u8 current;
+  while ((current = current_char(scanner)) != '\n')
+  {
+    if (current == 0 && is_out_of_bounds(scanner))
     {
       return;
     }
-    u8 current = current_char(scanner);
-    if (isdigit(current) || isalpha(current))
+    advance(scanner);
+  }
+}
+
+// false when the input ends first, with the index left at the end
+static bool skip_block_comment_scalar(Scanner* scanner)
+{
+  while (true)
+  {
+    u8 current = advance(scanner);
+    if (current == '*' && current_char(scanner) == '/')
     {
-      return;
+      advance(scanner);
+      return true;
     }
-    switch (current)
-    {
-    case '/':
+    if (current == 0 && is_out_of_bounds(scanner))
     {
-      advance(scanner);
-      if (match_next(scanner, '/'))
-      {
-        while (!is_out_of_bounds(scanner) && current_char(scanner) != '\n')
-        {
-          advance(scanner);
-        }
-        scanner->line++;
-        break;
-      }
-      scanner->index--;
-      return;
+      scanner->index = scanner->input->len;
+      return false;
     }
+  }
+}
 
-    case '\"':
-    case '{':
-    case '[':
-    case ']':
-    case '}':
-    case '*':
-    case ';':
-    case '<':
-    case '>':
-    case '(':
-    case ')':
-    case '!':
-    case '%':
-    case '.':
-    case '#':
-    case '^':
-    case ':':
-    case ',':
-    case '&':
-    case '|':
-    case '-':
-    case '+':
-    case '=':
-    case '\'':
+// stops at the first byte that ends or escapes a string literal, or at a
+// newline which can't be part of one
+static void skip_string_chars_scalar(Scanner* scanner)
+{
+  while (!is_out_of_bounds(scanner))
+  {
+    u8 current = current_char(scanner);
+    if (current == '\"' || current == '\\' || current == '\n')
     {
       return;
     }
-    case '\n':
-    {
-      scanner->line++;
-    }
-    default:
-    {
-      scanner->index++;
-    }
-    }
+    advance(scanner);
   }
 }
 
-static Token* parse_string(Scanner* scanner)
+#if defined(__SSE2__)
+#include <immintrin.h>
+
+/*
+  Each vector step builds a bitmask with one bit per byte and the first
+  interesting byte is found with ctz.
+*/
+
+static inline u32 blank_mask_sse2(__m128i v)
+{
+  __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+  // '\t'..'\r', bytes >= 0x80 compare as negative and fall outside the range
+  __m128i ctrl  = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+  return _mm_movemask_epi8(_mm_or_si128(space, ctrl));
+}
+
+static inline u32 byte_mask_sse2(__m128i v, char c)
 {
-  i32 index   = scanner->index;
-  u8  current = advance(scanner);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
 
-  while (!is_out_of_bounds(scanner) && current != '\"')
+static void skip_blank_sse2(Scanner* scanner)
+{
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 16 <= scanner->input->len)
   {
-    current = advance(scanner);
+    u32 other = ~blank_mask_sse2(_mm_loadu_si128((const __m128i*)&buffer[scanner->index])) & 0xFFFF;
+    if (other)
+    {
+      scanner->index += __builtin_ctz(other);
+      return;
+    }
+    scanner->index += 16;
   }
-  if (is_out_of_bounds(scanner))
+  skip_blank_scalar(scanner);
+}
+
+static void skip_line_comment_sse2(Scanner* scanner)
+{
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 16 <= scanner->input->len)
   {
-    error("Unterminated string!");
+    u32 lines = byte_mask_sse2(_mm_loadu_si128((const __m128i*)&buffer[scanner->index]), '\n');
+    if (lines)
+    {
+      scanner->index += __builtin_ctz(lines);
+      return;
+    }
+    scanner->index += 16;
   }
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[index];
-  literal.len    = scanner->index - index - 1;
+  skip_line_comment_scalar(scanner);
+}
 
-  return create_token(scanner->arena, TOKEN_STRING_CONSTANT, literal, scanner->line, scanner->index);
+static bool skip_block_comment_sse2(Scanner* scanner)
+{
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  // needs one extra byte for the shifted load that checks the '/' after '*'
+  while (scanner->index + 17 <= scanner->input->len)
+  {
+    __m128i v    = _mm_loadu_si128((const __m128i*)&buffer[scanner->index]);
+    __m128i next = _mm_loadu_si128((const __m128i*)&buffer[scanner->index + 1]);
+    u32     end  = byte_mask_sse2(v, '*') & byte_mask_sse2(next, '/');
+    if (end)
+    {
+      scanner->index += __builtin_ctz(end) + 2;
+      return true;
+    }
+    scanner->index += 16;
+  }
+  return skip_block_comment_scalar(scanner);
 }
 
-static TokenType get_keyword(String literal)
+static void skip_string_chars_sse2(Scanner* scanner)
 {
-  static const char* keywords[] = {"auto",   "break",  "case",    "char",   "const",    "continue", "default",  "do",       "double", "else",     "enum",      "extern", "float",
-                                   "for",    "goto",   "if",      "inline", "int",      "long",     "register", "restrict", "return", "short",    "signed",    "sizeof", "static",
-                                   "struct", "switch", "typedef", "union",  "unsinged", "void",     "volatile", "while",    "_Bool",  "_Complex", "_Imaginary"};
-  static TokenType   tokens[]   = {
-      TOKEN_AUTO,   TOKEN_BREAK,  TOKEN_CASE,    TOKEN_CHAR,   TOKEN_CONST,    TOKEN_CONTINUE, TOKEN_DEFAULT,  TOKEN_DO,       TOKEN_DOUBLE, TOKEN_ELSE,    TOKEN_ENUM,      TOKEN_EXTERN, TOKEN_FLOAT,
-      TOKEN_FOR,    TOKEN_GOTO,   TOKEN_IF,      TOKEN_INLINE, TOKEN_INT,      TOKEN_LONG,     TOKEN_REGISTER, TOKEN_RESTRICT, TOKEN_RETURN, TOKEN_SHORT,   TOKEN_SIGNED,    TOKEN_SIZEOF, TOKEN_STATIC,
-      TOKEN_STRUCT, TOKEN_SWITCH, TOKEN_TYPEDEF, TOKEN_UNION,  TOKEN_UNSIGNED, TOKEN_VOID,     TOKEN_VOLATILE, TOKEN_WHILE,    TOKEN_BOOL,   TOKEN_COMPLEX, TOKEN_IMAGINARY,
-  };
-  u32 number_of_keywords = ArrayCount(keywords);
-  for (u32 i = 0; i < number_of_keywords; i++)
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 16 <= scanner->input->len)
   {
-    if (literal.len == strlen(keywords[i]) && strncmp(keywords[i], literal.buffer, literal.len) == 0)
+    __m128i v    = _mm_loadu_si128((const __m128i*)&buffer[scanner->index]);
+    u32     stop = byte_mask_sse2(v, '\"') | byte_mask_sse2(v, '\\') | byte_mask_sse2(v, '\n');
+    if (stop)
     {
-      return tokens[i];
+      scanner->index += __builtin_ctz(stop);
+      return;
     }
+    scanner->index += 16;
   }
-  return TOKEN_IDENTIFIER;
+  skip_string_chars_scalar(scanner);
 }
 
-static Token* parse_keyword(Scanner* scanner)
+static void find_lines_sse2(LineTable* lines, Arena* arena, String* input, u64* index, u32 base)
 {
-  i32 index   = scanner->index - 1;
-  u8  current = advance(scanner);
-  while (!is_out_of_bounds(scanner) && (isdigit(current) || isalpha(current) || current == '_'))
+  const u8* buffer = (const u8*)input->buffer;
+  for (; *index + 16 <= input->len; *index += 16)
   {
-    current = advance(scanner);
+    u32 mask = byte_mask_sse2(_mm_loadu_si128((const __m128i*)&buffer[*index]), '\n');
+    while (mask)
+    {
+      push_line_start(lines, arena, base + *index + __builtin_ctz(mask) + 1);
+      mask &= mask - 1;
+    }
   }
+}
 
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[index];
-  scanner->index--;
-  literal.len = scanner->index - index;
-  return create_token(scanner->arena, get_keyword(literal), literal, scanner->line, scanner->index);
+__attribute__((target("avx2"))) static inline u32 blank_mask_avx2(__m256i v)
+{
+  __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+  __m256i ctrl  = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+  return _mm256_movemask_epi8(_mm256_or_si256(space, ctrl));
 }
 
-static bool is_valid_hex(char c)
+__attribute__((target("avx2"))) static inline u32 byte_mask_avx2(__m256i v, char c)
 {
-  return ('a' <= c && c <= 'f') || ('A' <= c && c <= 'F');
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
 }
 
-static Token* parse_hex(Scanner* scanner, i32 index)
+__attribute__((target("avx2"))) static void skip_blank_avx2(Scanner* scanner)
 {
-  char      current = advance(scanner);
-  TokenType type    = TOKEN_INT_HEX_CONSTANT;
-  while (!is_out_of_bounds(scanner) && (isdigit(current) || is_valid_hex(current)))
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 32 <= scanner->input->len)
   {
-    current = advance(scanner);
+    u32 other = ~blank_mask_avx2(_mm256_loadu_si256((const __m256i*)&buffer[scanner->index]));
+    if (other)
+    {
+      scanner->index += __builtin_ctz(other);
+      return;
+    }
+    scanner->index += 32;
   }
+  skip_blank_sse2(scanner);
+}
 
-  if (current == '.')
+__attribute__((target("avx2"))) static void skip_line_comment_avx2(Scanner* scanner)
+{
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 32 <= scanner->input->len)
   {
-    type    = TOKEN_FLOAT_HEX_CONSTANT;
-    current = advance(scanner);
-    while (!is_out_of_bounds(scanner) && (isdigit(current) || is_valid_hex(current)))
+    u32 lines = byte_mask_avx2(_mm256_loadu_si256((const __m256i*)&buffer[scanner->index]), '\n');
+    if (lines)
     {
-      current = advance(scanner);
+      scanner->index += __builtin_ctz(lines);
+      return;
     }
+    scanner->index += 32;
+  }
+  skip_line_comment_sse2(scanner);
+}
 
-    // binary exponent part
-    if (current != 'p')
+__attribute__((target("avx2"))) static bool skip_block_comment_avx2(Scanner* scanner)
+{
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 33 <= scanner->input->len)
+  {
+    __m256i v    = _mm256_loadu_si256((const __m256i*)&buffer[scanner->index]);
+    __m256i next = _mm256_loadu_si256((const __m256i*)&buffer[scanner->index + 1]);
+    u32     end  = byte_mask_avx2(v, '*') & byte_mask_avx2(next, '/');
+    if (end)
     {
-      error("Expected p after float hex");
+      scanner->index += __builtin_ctz(end) + 2;
+      return true;
     }
-    // sign
-    match_next(scanner, '-');
-    match_next(scanner, '+');
-    // digit_sequence
-    current = current_char(scanner);
-    while (!is_out_of_bounds(scanner) && isdigit(current))
+    scanner->index += 32;
+  }
+  return skip_block_comment_sse2(scanner);
+}
+
+__attribute__((target("avx2"))) static void skip_string_chars_avx2(Scanner* scanner)
+{
+  const u8* buffer = (const u8*)scanner->input->buffer;
+  while (scanner->index + 32 <= scanner->input->len)
+  {
+    __m256i v    = _mm256_loadu_si256((const __m256i*)&buffer[scanner->index]);
+    u32     stop = byte_mask_avx2(v, '\"') | byte_mask_avx2(v, '\\') | byte_mask_avx2(v, '\n');
+    if (stop)
     {
-      current = advance(scanner);
+      scanner->index += __builtin_ctz(stop);
+      return;
     }
+    scanner->index += 32;
   }
-
-  scanner->index--;
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[index];
-  literal.len    = scanner->index - index;
-
-  return create_token(scanner->arena, type, literal, scanner->line, scanner->index);
+  skip_string_chars_sse2(scanner);
 }
 
-static Token* parse_binary(Scanner* scanner, i32 index)
+__attribute__((target("avx2"))) static void find_lines_avx2(LineTable* lines, Arena* arena, String* input, u64* index, u32 base)
 {
-  char current = advance(scanner);
-  while (!is_out_of_bounds(scanner) && (current == '0' || current == '1'))
+  const u8* buffer = (const u8*)input->buffer;
+  for (; *index + 32 <= input->len; *index += 32)
   {
-    current = advance(scanner);
+    u32 mask = byte_mask_avx2(_mm256_loadu_si256((const __m256i*)&buffer[*index]), '\n');
+    while (mask)
+    {
+      push_line_start(lines, arena, base + *index + __builtin_ctz(mask) + 1);
+      mask &= mask - 1;
+    }
   }
-  scanner->index--;
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[index];
-  literal.len    = scanner->index - index;
-  return create_token(scanner->arena, TOKEN_INT_CONSTANT, literal, scanner->line, scanner->index);
+  find_lines_sse2(lines, arena, input, index, base);
 }
 
-static Token* parse_pound_define(Scanner* scanner)
+static void (*skip_blank)(Scanner*)         = skip_blank_sse2;
+static void (*skip_line_comment)(Scanner*)  = skip_line_comment_sse2;
+static bool (*skip_block_comment)(Scanner*) = skip_block_comment_sse2;
+static void (*skip_string_chars)(Scanner*)  = skip_string_chars_sse2;
+static void (*find_lines)(LineTable*, Arena*, String*, u64*, u32) = find_lines_sse2;
+
+static void init_skip_functions(void)
 {
-  char current = current_char(scanner);
-  while (!is_out_of_bounds(scanner) && !(isalpha(current) || isdigit(current)))
+  if (__builtin_cpu_supports("avx2"))
   {
+    skip_blank         = skip_blank_avx2;
+    skip_line_comment  = skip_line_comment_avx2;
+    skip_block_comment = skip_block_comment_avx2;
+    skip_string_chars  = skip_string_chars_avx2;
+    find_lines         = find_lines_avx2;
   }
-  return 0;
 }
+#else
+static void find_lines_scalar(LineTable* lines, Arena* arena, String* input, u64* index, u32 base)
+{
+  // the tail loop in find_line_starts covers the whole input
+}
+
+static void (*skip_blank)(Scanner*)         = skip_blank_scalar;
+static void (*skip_line_comment)(Scanner*)  = skip_line_comment_scalar;
+static bool (*skip_block_comment)(Scanner*) = skip_block_comment_scalar;
+static void (*skip_string_chars)(Scanner*)  = skip_string_chars_scalar;
+static void (*find_lines)(LineTable*, Arena*, String*, u64*, u32) = find_lines_scalar;
 
-static inline bool is_valid_octal(char current)
+static void init_skip_functions(void)
 {
-  return '0' <= current && current <= '7';
 }
+#endif
 
-static Token* parse_octal(Scanner* scanner, int index)
+/*
+  With refill set, comments and blanks that run into the end of a stream
+  window go on in the next one and the skipped bytes are dropped, whatever
+  comes after them starts with at least half a window ahead. Only a single
+  token is bounded by the window then. Between the pieces of a string the
+  token has already started, so the window can't move there.
+*/
+static void finish_line_comment(Scanner* scanner, bool refill)
 {
-  char current = advance(scanner);
-  while (!is_out_of_bounds(scanner) && is_valid_octal(current))
+  skip_line_comment(scanner);
+  while (refill && is_out_of_bounds(scanner) && refill_stream(scanner))
   {
-    current = advance(scanner);
+    skip_line_comment(scanner);
   }
-
-  scanner->index--;
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[index];
-  literal.len    = scanner->index - index;
-  return create_token(scanner->arena, TOKEN_OCTAL_CONSTANT, literal, scanner->line, scanner->index);
 }
 
-static Token* parse_number(Scanner* scanner)
+static void finish_block_comment(Scanner* scanner, bool refill)
 {
-  // integer-constant
-  //  decimal integer-suffix (opt)
-  //  octal-constant integer-suffix (opt)
-  //  hexadecimal-constant integer-suffix (opt)
-
-  // floating-constant
-  //  decimal-floating-constant
-  //  hexadecimal-floating-constant
-  i32       index   = scanner->index - 1;
-  TokenType type    = TOKEN_INT_CONSTANT;
-
-  char      current = advance(scanner);
-  if (scanner->input->buffer[index] == '0')
+  u64 body = scanner->index;
+  while (!skip_block_comment(scanner))
   {
-    if (current == 'x' || current == 'X')
-    {
-      return parse_hex(scanner, index);
-    }
-    else if (current == 'b')
+    String* input = scanner->input;
+    // a '*' ending the window can be closed by a '/' starting the next one
+    if (refill && input->len > body && input->buffer[input->len - 1] == '*')
     {
-      return parse_binary(scanner, index);
+      scanner->index = input->len - 1;
     }
-    else if (isdigit(current))
+    if (!refill || !refill_stream(scanner))
     {
-      return parse_octal(scanner, index);
+      error_at(scanner, input->len, "Unterminated comment!");
     }
+    body = 0;
   }
+}
 
-  while (!is_out_of_bounds(scanner) && isdigit(current))
-  {
-    current = advance(scanner);
-  }
-
-  if (current == '.')
+static void skip_whitespace(Scanner* scanner, bool refill)
+{
+  while (true)
   {
-    current = current_char(scanner);
-    type    = TOKEN_FLOAT_CONSTANT;
+    skip_blank(scanner);
+    if (refill && refill_stream(scanner))
+    {
+      continue;
+    }
+    if (is_out_of_bounds(scanner))
+    {
+      return;
+    }
 
-    while (!is_out_of_bounds(scanner) && isdigit(current))
+    u8 current = current_char(scanner);
+    if (current == '/' && scanner->index + 1 < scanner->input->len)
+    {
+      u8 next = scanner->input->buffer[scanner->index + 1];
+      if (next == '/')
+      {
+        scanner->index += 2;
+        finish_line_comment(scanner, refill);
+        continue;
+      }
+      if (next == '*')
+      {
+        scanner->index += 2;
+        finish_block_comment(scanner, refill);
+        continue;
+      }
+    }
+    if (char_info[current].class != CLASS_NONE)
     {
-      current = advance(scanner);
+      return;
     }
+    scanner->index++;
   }
-  scanner->index--;
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[index];
-  literal.len    = scanner->index - index;
-  return create_token(scanner->arena, type, literal, scanner->line, scanner->index);
 }
 
-Token* parse_character(Scanner* scanner)
+// from after the opening quote to after the closing one, false when a
+// newline or the end of the input comes first
+static bool skip_string(Scanner* scanner, bool* escaped)
 {
-  String literal = {};
-  literal.buffer = (char*)&scanner->input->buffer[scanner->index];
-  literal.len    = 1;
-  advance(scanner);
-  if (!match_next(scanner, '\''))
+  while (true)
   {
-    error("Expected ' after character?");
+    skip_string_chars(scanner);
+    if (is_out_of_bounds(scanner))
+    {
+      return false;
+    }
+    u8 current = advance(scanner);
+    if (current == '\"')
+    {
+      return true;
+    }
+    if (current == '\n')
+    {
+      return false;
+    }
+    // the escaped byte can't end the string, it's checked when decoding
+    *escaped = true;
+    scanner->index++;
   }
-  return create_token(scanner->arena, TOKEN_CHARACTER_CONSTANT, literal, scanner->line, scanner->index);
 }
 
-Token* parse_token(Scanner* scanner)
+static u32 push_string(Scanner* scanner, String string)
 {
-  skip_whitespace(scanner);
-  if (is_out_of_bounds(scanner))
-  {
-    String literal = {};
-    literal.buffer = "EOF";
-    literal.len    = 3;
-    return create_token(scanner->arena, TOKEN_EOF, literal, scanner->line, scanner->index);
-  }
-
-  char current = advance(scanner);
-
-  if (isalpha(current))
+  StringTable* strings = &scanner->strings;
+  if (strings->count == strings->capacity)
   {
-    return parse_keyword(scanner);
+    u32     capacity = strings->capacity ? strings->capacity * 2 : 64;
+    String* values   = sta_arena_push_array(scanner->arena, String, capacity);
+    if (strings->count)
+    {
+      memcpy(values, strings->values, strings->count * sizeof(String));
+    }
+    strings->values   = values;
+    strings->capacity = capacity;
   }
-
-  if (isdigit(current))
+  // the index has to fit the token's value
+  if (strings->count == 1 << 24)
   {
-    return parse_number(scanner);
+    error("Too many string literals!");
   }
+  strings->values[strings->count] = string;
+  return strings->count++;
+}
 
+// -1 for a backslash before a newline, which joins the lines
+static i32 decode_escape(Scanner* scanner)
+{
+  u8 current = advance(scanner);
   switch (current)
   {
-  case ':':
-  {
-    String literal = {};
-    literal.buffer = ":";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_COLON, literal, scanner->line, scanner->index);
-  }
-  case '{':
-  {
-    String literal = {};
-    literal.buffer = "{";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_LEFT_BRACE, literal, scanner->line, scanner->index);
-  }
-  case '}':
-  {
-    String literal = {};
-    literal.buffer = "}";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_RIGHT_BRACE, literal, scanner->line, scanner->index);
-  }
-  case '[':
-  {
-    String literal = {};
-    literal.buffer = "[";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_LEFT_BRACKET, literal, scanner->line, scanner->index);
-  }
-  case '\'':
+  case 'n':
   {
-    return parse_character(scanner);
+    return '\n';
   }
-  case ']':
+  case 't':
   {
-    String literal = {};
-    literal.buffer = "]";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_RIGHT_BRACKET, literal, scanner->line, scanner->index);
+    return '\t';
   }
-  case ';':
+  case 'r':
   {
-    String literal = {};
-    literal.buffer = ";";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_SEMICOLON, literal, scanner->line, scanner->index);
+    return '\r';
   }
-  case '%':
+  case 'a':
   {
-    String literal = {};
-    literal.buffer = "%";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_MOD, literal, scanner->line, scanner->index);
+    return '\a';
   }
-  case ',':
+  case 'b':
   {
-    String literal = {};
-    literal.buffer = ",";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_COMMA, literal, scanner->line, scanner->index);
+    return '\b';
   }
-  case '(':
+  case 'f':
   {
-    String literal = {};
-    literal.buffer = "(";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_LEFT_PAREN, literal, scanner->line, scanner->index);
+    return '\f';
   }
-  case ')':
+  case 'v':
   {
-    String literal = {};
-    literal.buffer = ")";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_RIGHT_PAREN, literal, scanner->line, scanner->index);
+    return '\v';
   }
-  case '/':
+  case '\\':
+  case '\'':
+  case '\"':
+  case '?':
   {
-    String literal = {};
-    literal.buffer = "/";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_SLASH, literal, scanner->line, scanner->index);
+    return current;
   }
-  case '*':
+  case '\n':
   {
-    String literal = {};
-    literal.buffer = "*";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_STAR, literal, scanner->line, scanner->index);
+    return -1;
   }
-  case '&':
+  case 'x':
   {
-    String literal = {};
-    if (match_next(scanner, '&'))
+    if (!has_flag(scanner, FLAG_HEX))
     {
-      literal.buffer = "&&";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_AND_LOGICAL, literal, scanner->line, scanner->index);
+      error_at(scanner, scanner->index - 2, "Expected hex digits after \\x");
     }
-
-    literal.buffer = "&";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_AND_BIT, literal, scanner->line, scanner->index);
-  }
-  case '|':
-  {
-    String literal = {};
-    if (match_next(scanner, '|'))
+    u32 value = 0;
+    while (has_flag(scanner, FLAG_HEX))
     {
-      literal.buffer = "||";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_OR_LOGICAL, literal, scanner->line, scanner->index);
+      value = value * 16 + digit_value(advance(scanner));
     }
-
-    literal.buffer = "|";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_OR_BIT, literal, scanner->line, scanner->index);
+    return value & 0xFF;
   }
-  case '!':
+  case '0' ... '7':
   {
-    String literal = {};
-    if (match_next(scanner, '='))
+    u32 value = current - '0';
+    for (u32 i = 0; i < 2 && has_flag(scanner, FLAG_OCTAL); i++)
     {
-      literal.buffer = "!=";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_BANG_EQUAL, literal, scanner->line, scanner->index);
+      value = value * 8 + advance(scanner) - '0';
     }
-    literal.buffer = "!";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_BANG, literal, scanner->line, scanner->index);
+    return value & 0xFF;
+  }
+  default:
+  {
+    error_at(scanner, scanner->index - 2, "Unknown escape sequence!");
+    exit(1);
+  }
   }
-  case '>':
+}
+
+// escapes resolved and adjacent literals joined into one arena buffer, the
+// raw bytes between the first and last quote bound its length
+static String decode_string(Scanner* scanner, i32 start, i32 end)
+{
+  String  out    = {.buffer = sta_arena_push_array(scanner->arena, char, end - start)};
+  Scanner cursor = *scanner;
+  cursor.index   = start;
+  while (cursor.index < end)
   {
-    String literal = {};
-    if (match_next(scanner, '='))
+    u8 current = advance(&cursor);
+    if (current == '\"')
     {
-      literal.buffer = ">=";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_GREATER_EQUAL, literal, scanner->line, scanner->index);
+      // closing quote of one piece, skip to the content of the next
+      skip_whitespace(&cursor, false);
+      cursor.index++;
+      continue;
     }
-    else if (match_next(scanner, '>'))
+    if (current == '\\')
     {
-      literal.buffer = ">>";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_SHIFT_RIGHT, literal, scanner->line, scanner->index);
+      i32 value = decode_escape(&cursor);
+      if (value < 0)
+      {
+        continue;
+      }
+      current = value;
     }
-    literal.buffer = ">";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_GREATER, literal, scanner->line, scanner->index);
+    out.buffer[out.len++] = current;
   }
-  case '-':
+  return out;
+}
+
+static TokenType parse_string(Scanner* scanner, String* literal)
+{
+  // adjacent literals, with only whitespace and comments between, are one token
+  i32  start   = scanner->index;
+  i32  end     = start;
+  bool escaped = false;
+  u32  pieces  = 0;
+  i32  after   = start;
+  do
   {
-    String literal = {};
-    if (match_next(scanner, '-'))
+    if (!skip_string(scanner, &escaped))
     {
-      literal.buffer = "--";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_DECREMENT, literal, scanner->line, scanner->index);
+      error_at(scanner, start - 1, "Unterminated string!");
     }
-    literal.buffer = "-";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_MINUS, literal, scanner->line, scanner->index);
+    end = scanner->index - 1;
+    pieces++;
+    after = scanner->index;
+    skip_whitespace(scanner, false);
+  } while (match_next(scanner, '\"'));
+  // what follows the last piece is skipped again before the next token,
+  // where a stream window can move. One that ran out stays for next_token
+  if (!is_out_of_bounds(scanner))
+  {
+    scanner->index = after;
   }
-  case '+':
+
+  literal->buffer = (char*)&scanner->input->buffer[start];
+  literal->len    = end - start;
+
+  // the common case stays a slice of the input
+  push_string(scanner, escaped || pieces > 1 ? decode_string(scanner, start, end) : keep_literal(scanner, *literal));
+  return TOKEN_STRING_CONSTANT;
+}
+
+typedef struct
+{
+  const char* name;
+  u8          len;
+  TokenType   type;
+} Keyword;
+
+/*
+  Perfect hash over length, first and last character. The constants were
+  picked so that all 37 keywords land in distinct slots of a 128 entry
+  table, the slots themselves are computed by the compiler through
+  KEYWORD_HASH. An identifier costs one table load and at most one memcmp.
+*/
+#define KEYWORD_HASH(first, last, len)  (((len) + (first) * 10 + (last) * 3) & 127)
+#define KEYWORD(name, first, last, type) [KEYWORD_HASH(first, last, sizeof(name) - 1)] = {name, sizeof(name) - 1, type}
+
+static const Keyword keywords[128] = {
+    KEYWORD("auto", 'a', 'o', TOKEN_AUTO),
+    KEYWORD("break", 'b', 'k', TOKEN_BREAK),
+    KEYWORD("case", 'c', 'e', TOKEN_CASE),
+    KEYWORD("char", 'c', 'r', TOKEN_CHAR),
+    KEYWORD("const", 'c', 't', TOKEN_CONST),
+    KEYWORD("continue", 'c', 'e', TOKEN_CONTINUE),
+    KEYWORD("default", 'd', 't', TOKEN_DEFAULT),
+    KEYWORD("do", 'd', 'o', TOKEN_DO),
+    KEYWORD("double", 'd', 'e', TOKEN_DOUBLE),
+    KEYWORD("else", 'e', 'e', TOKEN_ELSE),
+    KEYWORD("enum", 'e', 'm', TOKEN_ENUM),
+    KEYWORD("extern", 'e', 'n', TOKEN_EXTERN),
+    KEYWORD("float", 'f', 't', TOKEN_FLOAT),
+    KEYWORD("for", 'f', 'r', TOKEN_FOR),
+    KEYWORD("goto", 'g', 'o', TOKEN_GOTO),
+    KEYWORD("if", 'i', 'f', TOKEN_IF),
+    KEYWORD("inline", 'i', 'e', TOKEN_INLINE),
+    KEYWORD("int", 'i', 't', TOKEN_INT),
+    KEYWORD("long", 'l', 'g', TOKEN_LONG),
+    KEYWORD("register", 'r', 'r', TOKEN_REGISTER),
+    KEYWORD("restrict", 'r', 't', TOKEN_RESTRICT),
+    KEYWORD("return", 'r', 'n', TOKEN_RETURN),
+    KEYWORD("short", 's', 't', TOKEN_SHORT),
+    KEYWORD("signed", 's', 'd', TOKEN_SIGNED),
+    KEYWORD("sizeof", 's', 'f', TOKEN_SIZEOF),
+    KEYWORD("static", 's', 'c', TOKEN_STATIC),
+    KEYWORD("struct", 's', 't', TOKEN_STRUCT),
+    KEYWORD("switch", 's', 'h', TOKEN_SWITCH),
+    KEYWORD("typedef", 't', 'f', TOKEN_TYPEDEF),
+    KEYWORD("union", 'u', 'n', TOKEN_UNION),
+    KEYWORD("unsigned", 'u', 'd', TOKEN_UNSIGNED),
+    KEYWORD("void", 'v', 'd', TOKEN_VOID),
+    KEYWORD("volatile", 'v', 'e', TOKEN_VOLATILE),
+    KEYWORD("while", 'w', 'e', TOKEN_WHILE),
+    KEYWORD("_Bool", '_', 'l', TOKEN_BOOL),
+    KEYWORD("_Complex", '_', 'x', TOKEN_COMPLEX),
+    KEYWORD("_Imaginary", '_', 'y', TOKEN_IMAGINARY),
+};
+
+#undef KEYWORD
+
+TokenType get_keyword(String literal)
+{
+  if (literal.len < 2 || literal.len > 10)
   {
-    String literal = {};
-    if (match_next(scanner, '+'))
-    {
-      literal.buffer = "++";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_INCREMENT, literal, scanner->line, scanner->index);
-    }
-    literal.buffer = "+";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_PLUS, literal, scanner->line, scanner->index);
+    return TOKEN_IDENTIFIER;
   }
-  case '=':
+  u8             first   = literal.buffer[0];
+  u8             last    = literal.buffer[literal.len - 1];
+  const Keyword* keyword = &keywords[KEYWORD_HASH(first, last, literal.len)];
+  if (keyword->len == literal.len && memcmp(keyword->name, literal.buffer, literal.len) == 0)
   {
-    String literal = {};
-    if (match_next(scanner, '='))
-    {
-      literal.buffer = "==";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_EQUAL_EQUAL, literal, scanner->line, scanner->index);
-    }
-    literal.buffer = "=";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_EQUAL, literal, scanner->line, scanner->index);
+    return keyword->type;
   }
-  case '<':
+  return TOKEN_IDENTIFIER;
+}
+
+static TokenType make_token(Scanner* scanner, TokenType type, i32 start, String* literal)
+{
+  literal->buffer = &scanner->input->buffer[start];
+  literal->len    = scanner->index - start;
+  return type;
+}
+
+static TokenType parse_keyword(Scanner* scanner, i32 start, String* literal)
+{
+  skip_while(scanner, FLAG_IDENTIFIER);
+  make_token(scanner, TOKEN_IDENTIFIER, start, literal);
+  return get_keyword(*literal);
+}
+
+// e, an optional sign and at least one digit, otherwise nothing is consumed
+static bool skip_exponent(Scanner* scanner)
+{
+  i32 start = scanner->index;
+  if (match_next(scanner, 'e') || match_next(scanner, 'E'))
   {
-    String literal = {};
-    if (match_next(scanner, '='))
+    if (!match_next(scanner, '-'))
     {
-      literal.buffer = "<=";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_LESS_EQUAL, literal, scanner->line, scanner->index);
+      match_next(scanner, '+');
     }
-    else if (match_next(scanner, '<'))
+    if (has_flag(scanner, FLAG_DIGIT))
     {
-      literal.buffer = "<<";
-      literal.len    = 2;
-      return create_token(scanner->arena, TOKEN_SHIFT_LEFT, literal, scanner->line, scanner->index);
+      skip_while(scanner, FLAG_DIGIT);
+      return true;
     }
-    literal.buffer = "<";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_LESS, literal, scanner->line, scanner->index);
   }
-  case '^':
+  scanner->index = start;
+  return false;
+}
+
+// after the 0x, there has to be a digit before or after the point
+static TokenType parse_hex(Scanner* scanner, i32 start, String* literal)
+{
+  TokenType type   = TOKEN_INT_HEX_CONSTANT;
+  i32       digits = scanner->index;
+  skip_while(scanner, FLAG_HEX);
+
+  bool fraction = match_next(scanner, '.');
+  if (fraction)
   {
-    String literal = {};
-    literal.buffer = "^";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_XOR, literal, scanner->line, scanner->index);
+    skip_while(scanner, FLAG_HEX);
   }
-  case '.':
+  if (scanner->index - digits == fraction)
   {
-    String literal      = {};
-    int    match_length = 2;
-    if (isdigit(current_char(scanner)))
+    error_at(scanner, scanner->index, "Expected hex digits after 0x");
+  }
+  // binary exponent part, required after a fraction
+  if (match_next(scanner, 'p') || match_next(scanner, 'P'))
+  {
+    type = TOKEN_FLOAT_HEX_CONSTANT;
+    // sign
+    if (!match_next(scanner, '-'))
     {
-      // .5;
+      match_next(scanner, '+');
     }
-    else if (match_substring(scanner, "..", match_length))
+    // digit_sequence
+    if (!has_flag(scanner, FLAG_DIGIT))
     {
-      literal.buffer = "...";
-      literal.len    = 3;
-      return create_token(scanner->arena, TOKEN_ELLIPSIS, literal, scanner->line, scanner->index);
+      error_at(scanner, scanner->index, "Expected digits in the exponent");
     }
-    literal.buffer = ".";
-    literal.len    = 1;
-    return create_token(scanner->arena, TOKEN_DOT, literal, scanner->line, scanner->index);
+    skip_while(scanner, FLAG_DIGIT);
   }
-  case '\"':
+  else if (fraction)
   {
-    return parse_string(scanner);
+    error_at(scanner, scanner->index, "Expected p after float hex");
   }
-  case '#':
+
+  return make_token(scanner, type, start, literal);
+}
+
+static TokenType parse_binary(Scanner* scanner, i32 start, String* literal)
+{
+  if (!has_flag(scanner, FLAG_BINARY))
   {
-    return parse_pound_define(scanner);
+    error_at(scanner, scanner->index, "Expected binary digits after 0b");
   }
-  default:
+  skip_while(scanner, FLAG_BINARY);
+  return make_token(scanner, TOKEN_BINARY_CONSTANT, start, literal);
+}
+
+static TokenType parse_pound_define(Scanner* scanner)
+{
+  error_at(scanner, scanner->index - 1, "Preprocessing directives aren't supported!");
+  exit(1);
+}
+
+// the digits are already skipped, a leading 0 only makes an octal integer
+static TokenType parse_octal(Scanner* scanner, i32 start, String* literal)
+{
+  for (i32 i = start + 1; i < scanner->index; i++)
   {
-    printf("%c %d\n", scanner->input->buffer[scanner->index], scanner->input->buffer[scanner->index]);
-    error("Illegal character!");
-    exit(1);
+    if (!(char_info[(u8)scanner->input->buffer[i]].flags & FLAG_OCTAL))
+    {
+      error_at(scanner, i, "Invalid digit in octal constant!");
+    }
+  }
+  return make_token(scanner, TOKEN_OCTAL_CONSTANT, start, literal);
+}
+
+static TokenType parse_number(Scanner* scanner, i32 start, String* literal)
+{
+  // integer-constant
+  //  decimal integer-suffix (opt)
+  //  octal-constant integer-suffix (opt)
+  //  hexadecimal-constant integer-suffix (opt)
+
+  // floating-constant
+  //  decimal-floating-constant
+  //  hexadecimal-floating-constant
+  if (scanner->input->buffer[start] == '0')
+  {
+    if (match_next(scanner, 'x') || match_next(scanner, 'X'))
+    {
+      return parse_hex(scanner, start, literal);
+    }
+    else if (match_next(scanner, 'b') || match_next(scanner, 'B'))
+    {
+      return parse_binary(scanner, start, literal);
+    }
+  }
+
+  // 01.5 and 0123e4 are decimal floats, so the digits come before the octal check
+  TokenType type = TOKEN_INT_CONSTANT;
+  skip_while(scanner, FLAG_DIGIT);
+  if (match_next(scanner, '.'))
+  {
+    type = TOKEN_FLOAT_CONSTANT;
+    skip_while(scanner, FLAG_DIGIT);
+  }
+  if (skip_exponent(scanner))
+  {
+    type = TOKEN_FLOAT_CONSTANT;
+  }
+  if (type == TOKEN_INT_CONSTANT && scanner->input->buffer[start] == '0' && scanner->index - start > 1)
+  {
+    return parse_octal(scanner, start, literal);
+  }
+  return make_token(scanner, type, start, literal);
+}
+
+/*
+  Numbers and characters are decoded as soon as their extent is known, while
+  the bytes are still in cache, and pushed in token order. The token keeps
+  the index so nothing after the scanner looks at the text again.
+*/
+static u32 push_constant(Scanner* scanner, Constant constant)
+{
+  ConstantTable* constants = &scanner->constants;
+  if (constants->count == constants->capacity)
+  {
+    u32       capacity = constants->capacity ? constants->capacity * 2 : 64;
+    Constant* values   = sta_arena_push_array(scanner->arena, Constant, capacity);
+    if (constants->count)
+    {
+      memcpy(values, constants->values, constants->count * sizeof(Constant));
+    }
+    constants->values   = values;
+    constants->capacity = capacity;
+  }
+  // the index has to fit the token's value
+  if (constants->count == 1 << 24)
+  {
+    error("Too many constants!");
+  }
+  constants->values[constants->count] = constant;
+  return constants->count++;
+}
+
+static u64 decode_integer(Scanner* scanner, String literal, u32 base, u32 prefix)
+{
+  u64 value = 0;
+  for (u64 i = prefix; i < literal.len; i++)
+  {
+    if (__builtin_mul_overflow(value, base, &value) || __builtin_add_overflow(value, digit_value(literal.buffer[i]), &value))
+    {
+      error_at(scanner, literal.buffer - scanner->input->buffer, "Integer constant is too large!");
+    }
+  }
+  return value;
+}
+
+// strtod wants a terminated string, it is exact for decimal and hex input
+static f64 decode_float_slow(Scanner* scanner, String literal)
+{
+  ArenaMarker scratch = sta_get_scratch(scanner->arena);
+  char*       text    = sta_arena_push_array(scratch.arena, char, literal.len + 1);
+  memcpy(text, literal.buffer, literal.len);
+  text[literal.len] = 0;
+  f64 value         = strtod(text, 0);
+  sta_arena_restore(scratch);
+  return value;
+}
+
+// the exponent after e or p, large enough to saturate any double
+static i32 decode_exponent(String literal, u64 i)
+{
+  bool negative = literal.buffer[i] == '-';
+  i += negative || literal.buffer[i] == '+';
+  i32 exponent = 0;
+  for (; i < literal.len; i++)
+  {
+    exponent = MIN(exponent * 10 + literal.buffer[i] - '0', 100000);
+  }
+  return negative ? -exponent : exponent;
+}
+
+static f64 decode_float(Scanner* scanner, String literal)
+{
+  // up to 19 significant digits, the rest only moves the exponent
+  u64  mantissa  = 0;
+  i32  exponent  = 0;
+  u32  digits    = 0;
+  bool fraction  = false;
+  bool truncated = false;
+  u64  i         = 0;
+  for (; i < literal.len; i++)
+  {
+    u8 c = literal.buffer[i];
+    if (c == '.')
+    {
+      fraction = true;
+      continue;
+    }
+    u8 digit = c - '0';
+    if (digit > 9)
+    {
+      break;
+    }
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + digit;
+      digits += mantissa != 0;
+      exponent -= fraction;
+    }
+    else
+    {
+      truncated |= digit != 0;
+      exponent += !fraction;
+    }
+  }
+  if (i < literal.len)
+  {
+    exponent += decode_exponent(literal, i + 1);
+  }
+
+  f64 value;
+  if (truncated || !decimal_to_double(mantissa, exponent, &value))
+  {
+    return decode_float_slow(scanner, literal);
+  }
+  return value;
+}
+
+static f64 decode_hex_float(Scanner* scanner, String literal)
+{
+  u64  mantissa = 0;
+  i32  exponent = 0;
+  bool fraction = false;
+  u64  i        = 2;
+  for (; (literal.buffer[i] | 0x20) != 'p'; i++)
+  {
+    if (literal.buffer[i] == '.')
+    {
+      fraction = true;
+      continue;
+    }
+    if (mantissa >> 53)
+    {
+      return decode_float_slow(scanner, literal);
+    }
+    mantissa = mantissa << 4 | digit_value(literal.buffer[i]);
+    exponent -= fraction * 4;
+  }
+  exponent += decode_exponent(literal, i + 1);
+
+  // the mantissa converts exactly, scaling it rounds once
+  if (mantissa >> 53)
+  {
+    return decode_float_slow(scanner, literal);
+  }
+  return ldexp((f64)mantissa, exponent);
+}
+
+// u, l, ll and their combinations in either case, or f. Anything else is
+// returned as TOKEN_IDENTIFIER
+static TokenType suffix_type(String suffix)
+{
+  static const TokenType types[2][3] = {
+      {       TOKEN_IDENTIFIER,          TOKEN_LONG_POSTFIX,          TOKEN_LONG_LONG_POSTFIX},
+      {TOKEN_UNSIGNED_POSTFIX, TOKEN_UNSIGNED_LONG_POSTFIX, TOKEN_UNSIGNED_LONG_LONG_POSTFIX},
+  };
+  char* buffer = suffix.buffer;
+  if (suffix.len == 1 && (buffer[0] | 0x20) == 'f')
+  {
+    return TOKEN_FLOAT_POSTFIX;
   }
+
+  bool is_unsigned = false;
+  u32  longs       = 0;
+  u64  i           = 0;
+  if (i < suffix.len && (buffer[i] | 0x20) == 'u')
+  {
+    is_unsigned = true;
+    i++;
+  }
+  if (i < suffix.len && (buffer[i] | 0x20) == 'l')
+  {
+    // lL and Ll aren't suffixes
+    longs = i + 1 < suffix.len && buffer[i + 1] == buffer[i] ? 2 : 1;
+    i += longs;
+  }
+  if (!is_unsigned && i < suffix.len && (buffer[i] | 0x20) == 'u')
+  {
+    is_unsigned = true;
+    i++;
+  }
+  return i == suffix.len ? types[is_unsigned][longs] : TOKEN_IDENTIFIER;
+}
+
+static const u64 integer_max[] = {
+    [CONSTANT_INT] = INT32_MAX,       [CONSTANT_UNSIGNED_INT] = UINT32_MAX,       [CONSTANT_LONG] = INT64_MAX,
+    [CONSTANT_UNSIGNED_LONG] = UINT64_MAX, [CONSTANT_LONG_LONG] = INT64_MAX, [CONSTANT_UNSIGNED_LONG_LONG] = UINT64_MAX,
+};
+
+// the first class from the smallest the suffix allows that holds the value,
+// unsigned ones only with a u or for octal and hex
+static ConstantClass integer_class(u64 value, ConstantClass smallest, bool decimal)
+{
+  bool unsigned_suffix = smallest & 1;
+  for (ConstantClass class = smallest; class <= CONSTANT_UNSIGNED_LONG_LONG; class++)
+  {
+    bool is_unsigned = class & 1;
+    if (is_unsigned != unsigned_suffix && (unsigned_suffix || decimal))
+    {
+      continue;
+    }
+    if (value <= integer_max[class])
+    {
+      return class;
+    }
   }
+  // too large for any signed type, taken as unsigned like gcc does
+  return CONSTANT_UNSIGNED_LONG_LONG;
+}
+
+static TokenType decode_constant(Scanner* scanner, TokenType type, String literal)
+{
+  // the suffix is lexed as a token of its own, here only its meaning is needed
+  String suffix = {.buffer = &scanner->input->buffer[scanner->index]};
+  while (char_info[(u8)suffix.buffer[suffix.len]].flags & FLAG_IDENTIFIER)
+  {
+    suffix.len++;
+  }
+  TokenType suffix_token = suffix.len > 0 ? suffix_type(suffix) : TOKEN_EOF;
+  if (suffix.len > 0)
+  {
+    scanner->suffix_start = scanner->index;
+  }
+
+  Constant constant = {.literal = keep_literal(scanner, literal)};
+  bool     valid    = true;
+  if (type == TOKEN_FLOAT_CONSTANT || type == TOKEN_FLOAT_HEX_CONSTANT)
+  {
+    constant.floating = type == TOKEN_FLOAT_CONSTANT ? decode_float(scanner, literal) : decode_hex_float(scanner, literal);
+    constant.class    = suffix_token == TOKEN_FLOAT_POSTFIX ? CONSTANT_FLOAT : suffix_token == TOKEN_LONG_POSTFIX ? CONSTANT_LONG_DOUBLE : CONSTANT_DOUBLE;
+    valid             = suffix.len == 0 || suffix_token == TOKEN_FLOAT_POSTFIX || suffix_token == TOKEN_LONG_POSTFIX;
+  }
+  else
+  {
+    // 0 of an octal constant is just another digit
+    static const u8 bases[]    = {[TOKEN_INT_CONSTANT] = 10, [TOKEN_INT_HEX_CONSTANT] = 16, [TOKEN_OCTAL_CONSTANT] = 8, [TOKEN_BINARY_CONSTANT] = 2};
+    static const u8 prefixes[] = {[TOKEN_INT_CONSTANT] = 0, [TOKEN_INT_HEX_CONSTANT] = 2, [TOKEN_OCTAL_CONSTANT] = 0, [TOKEN_BINARY_CONSTANT] = 2};
+    constant.integer           = decode_integer(scanner, literal, bases[type], prefixes[type]);
+
+    // the integer suffixes are in the same order as the classes they start from
+    ConstantClass smallest = CONSTANT_INT;
+    if (suffix.len > 0)
+    {
+      valid    = suffix_token >= TOKEN_UNSIGNED_POSTFIX && suffix_token <= TOKEN_UNSIGNED_LONG_LONG_POSTFIX;
+      smallest = CONSTANT_UNSIGNED_INT + (suffix_token - TOKEN_UNSIGNED_POSTFIX);
+    }
+    constant.class = integer_class(constant.integer, smallest, type == TOKEN_INT_CONSTANT);
+  }
+  if (!valid)
+  {
+    error_at(scanner, scanner->index, "Invalid suffix on constant!");
+  }
+
+  push_constant(scanner, constant);
+  return type;
+}
+
+static TokenType parse_suffix(Scanner* scanner, i32 start, String* literal)
+{
+  skip_while(scanner, FLAG_IDENTIFIER);
+  make_token(scanner, TOKEN_IDENTIFIER, start, literal);
+  return suffix_type(*literal);
+}
+
+static TokenType parse_character(Scanner* scanner, String* literal)
+{
+  literal->buffer = (char*)&scanner->input->buffer[scanner->index];
+  literal->len    = 1;
+  // the character could be the 0 past the end, the quote is read after it
+  if (is_out_of_bounds(scanner))
+  {
+    error_at(scanner, scanner->index, "Expected ' after character?");
+  }
+  advance(scanner);
+  if (!match_next(scanner, '\''))
+  {
+    error_at(scanner, scanner->index, "Expected ' after character?");
+  }
+  push_constant(scanner, (Constant){.integer = (u8)literal->buffer[0], .literal = keep_literal(scanner, *literal), .class = CONSTANT_INT});
+  return TOKEN_CHARACTER_CONSTANT;
+}
+
+// lexes the next token without allocating, the literal points into the input
+static TokenType scan_token(Scanner* scanner, String* literal)
+{
+  // one indirect jump on the class of the first byte picks the routine
+  static void* dispatch[CLASS_COUNT] = {
+      [CLASS_NONE]       = &&invalid,    //
+      [CLASS_IDENTIFIER] = &&identifier, //
+      [CLASS_DIGIT]      = &&number,     //
+      [CLASS_PUNCTUATOR] = &&punctuator, //
+      [CLASS_OPERATOR]   = &&operator,   //
+      [CLASS_DOT]        = &&dot,        //
+      [CLASS_STRING]     = &&string,     //
+      [CLASS_CHARACTER]  = &&character,  //
+      [CLASS_POUND]      = &&pound,      //
+  };
+
+  skip_whitespace(scanner, scanner->stream != 0);
+  if (is_out_of_bounds(scanner))
+  {
+    literal->buffer = &scanner->input->buffer[scanner->index];
+    literal->len    = 0;
+    return TOKEN_EOF;
+  }
+
+  i32 start   = scanner->index;
+  u8  current = advance(scanner);
+  goto* dispatch[char_info[current].class];
+
+identifier:
+  if (start == scanner->suffix_start)
+  {
+    return parse_suffix(scanner, start, literal);
+  }
+  return parse_keyword(scanner, start, literal);
+
+number:
+  return decode_constant(scanner, parse_number(scanner, start, literal), *literal);
+
+punctuator:
+  return make_token(scanner, punctuators[current], start, literal);
+
+operator:
+{
+  const Operator* op = &operators[current];
+  u8              next = current_char(scanner);
+  if (next != 0)
+  {
+    for (u32 i = 0; i < ArrayCount(op->next); i++)
+    {
+      if (op->next[i] == next)
+      {
+        advance(scanner);
+        return make_token(scanner, op->pair[i], start, literal);
+      }
+    }
+  }
+  return make_token(scanner, op->single, start, literal);
+}
+
+dot:
+  if (has_flag(scanner, FLAG_DIGIT))
+  {
+    // .5
+    skip_while(scanner, FLAG_DIGIT);
+    skip_exponent(scanner);
+    make_token(scanner, TOKEN_FLOAT_CONSTANT, start, literal);
+    return decode_constant(scanner, TOKEN_FLOAT_CONSTANT, *literal);
+  }
+  if (scanner->index + 1 < scanner->input->len && current_char(scanner) == '.' && scanner->input->buffer[scanner->index + 1] == '.')
+  {
+    scanner->index += 2;
+    return make_token(scanner, TOKEN_ELLIPSIS, start, literal);
+  }
+  return make_token(scanner, TOKEN_DOT, start, literal);
+
+string:
+  return parse_string(scanner, literal);
+
+character:
+  return parse_character(scanner, literal);
+
+pound:
+  return parse_pound_define(scanner);
+
+invalid:
+  printf("%c %d\n", current, current);
+  error_at(scanner, start, "Illegal character!");
+  exit(1);
+}
+
+// numbers and characters, their token holds the index of the decoded value
+static bool is_decoded_constant(TokenType type)
+{
+  return type < TOKEN_STRING_CONSTANT;
+}
+
+// identifiers carry their symbol id, constants and strings the index of the
+// value pushed while lexing them, everything else its length
+static u32 token_value(Scanner* scanner, TokenType type, String literal)
+{
+  if (type == TOKEN_IDENTIFIER)
+  {
+    return intern(&scanner->symbols, scanner->arena, literal);
+  }
+  if (is_decoded_constant(type))
+  {
+    return scanner->constants.count - 1;
+  }
+  if (type == TOKEN_STRING_CONSTANT)
+  {
+    return scanner->strings.count - 1;
+  }
+  return literal.len;
+}
+
+// scan_token plus the offset of the token in the whole input. When streaming
+// skip_whitespace tops the window up before the token, one that still runs
+// into its end is longer than half of it
+static TokenType next_token(Scanner* scanner, String* literal, u32* offset)
+{
+  Stream*   stream = scanner->stream;
+  TokenType type   = scan_token(scanner, literal);
+  if (stream && scanner->index >= stream->window.len && !stream->eof)
+  {
+    error_at(scanner, literal->buffer - scanner->input->buffer, "Token longer than half the stream window!");
+  }
+  *offset = scanner->base + (literal->buffer - scanner->input->buffer);
+  return type;
+}
+
+Token parse_token(Scanner* scanner)
+{
+  String    literal = {};
+  u32       offset;
+  TokenType type = next_token(scanner, &literal, &offset);
+  return create_token(type, offset, token_value(scanner, type, literal));
+}
+
+static void grow_token_buffer(Arena* arena, TokenBuffer* tokens, u32 capacity)
+{
+  u8*  types   = sta_arena_push_array_tagged(arena, u8, capacity, "Token");
+  u32* offsets = sta_arena_push_array_tagged(arena, u32, capacity, "Token");
+  u32* values  = sta_arena_push_array_tagged(arena, u32, capacity, "Token");
+  // an empty buffer has no arrays yet, memcpy from 0 is undefined even for 0 bytes
+  if (tokens->count)
+  {
+    memcpy(types, tokens->types, tokens->count * sizeof(u8));
+    memcpy(offsets, tokens->offsets, tokens->count * sizeof(u32));
+    memcpy(values, tokens->values, tokens->count * sizeof(u32));
+  }
+  tokens->types    = types;
+  tokens->offsets  = offsets;
+  tokens->values   = values;
+  tokens->capacity = capacity;
+}
+
+void scan_tokens(Scanner* scanner, TokenBuffer* tokens)
+{
+  // C averages a token every few bytes, growing past this is rare
+  *tokens = (TokenBuffer){};
+  grow_token_buffer(scanner->arena, tokens, (scanner->input->len - scanner->index) / 4 + 16);
+
+  TokenType type;
+  do
+  {
+    if (tokens->count == tokens->capacity)
+    {
+      grow_token_buffer(scanner->arena, tokens, tokens->capacity * 2);
+    }
+    String literal        = {};
+    u32    index          = tokens->count++;
+    type                  = next_token(scanner, &literal, &tokens->offsets[index]);
+    tokens->types[index]  = type;
+    tokens->values[index] = token_value(scanner, type, literal);
+  } while (type != TOKEN_EOF);
+}
+
+/*
+  Finds up to chunk_count - 1 newlines, roughly evenly spaced, that are not
+  inside a string, character constant or comment. The serial lexer is
+  always between tokens at such a newline, so lexing from there gives the
+  same tokens. Only quotes, comment openers and newlines are inspected.
+  A newline that only has whitespace and comments since the last string
+  literal is passed over, the next token could be a string joining it.
+*/
+static u32 find_split_points(Scanner* scanner, u32* splits, u32 chunk_count)
+{
+  String* input  = scanner->input;
+  Scanner cursor = *scanner;
+  u32     count  = 1;
+  u64     target = input->len / chunk_count;
+  bool    joins  = false;
+  splits[0]      = 0;
+
+  while (cursor.index < input->len && count < chunk_count)
+  {
+    u8 current = advance(&cursor);
+    switch (current)
+    {
+    case '\"':
+    {
+      // unterminated ones stop at the newline, the lexer reports them
+      bool escaped;
+      skip_string(&cursor, &escaped);
+      joins = true;
+      continue;
+    }
+    case '\'':
+    {
+      // the character and the closing quote
+      cursor.index += 2;
+      break;
+    }
+    case '/':
+    {
+      if (match_next(&cursor, '/'))
+      {
+        skip_line_comment(&cursor);
+        continue;
+      }
+      if (match_next(&cursor, '*'))
+      {
+        finish_block_comment(&cursor, false);
+        continue;
+      }
+      break;
+    }
+    case '\n':
+    {
+      if (!joins && cursor.index - 1 >= target)
+      {
+        splits[count++] = cursor.index - 1;
+        target          = input->len * count / chunk_count;
+      }
+      continue;
+    }
+    }
+    joins &= is_blank(current);
+  }
+  return count;
+}
+
+typedef struct
+{
+  Scanner     scanner;
+  String      input;
+  TokenBuffer tokens;
+} LexChunk;
+
+// everything a chunk produces lands in the arena of the worker lexing it
+static void lex_chunk(void* data, Arena* arena)
+{
+  LexChunk* chunk      = data;
+  chunk->scanner.arena = arena;
+  TimeBandwidth(chunk_lexing, chunk->input.len - chunk->scanner.index);
+  scan_tokens(&chunk->scanner, &chunk->tokens);
+  ExitBlock(chunk_lexing);
+}
+
+void scan_tokens_parallel(Scanner* scanner, TokenBuffer* tokens, JobSystem* jobs, u32 chunk_count)
+{
+  // the chunks need the whole input in memory
+  if (chunk_count <= 1 || scanner->stream)
+  {
+    scan_tokens(scanner, tokens);
+    return;
+  }
+
+  u32 splits[chunk_count + 1];
+  chunk_count         = find_split_points(scanner, splits, chunk_count);
+  splits[chunk_count] = scanner->input->len;
+
+  // the chunks' tables are copied out below, then the worker arenas are
+  // rewound to here
+  ArenaMarker markers[jobs->worker_count];
+  for (u32 i = 0; i < jobs->worker_count; i++)
+  {
+    markers[i] = sta_arena_save(&jobs->workers[i].arena);
+  }
+
+  LexChunk chunks[chunk_count];
+  for (u32 i = 0; i < chunk_count; i++)
+  {
+    LexChunk* chunk = &chunks[i];
+    // same buffer so offsets stay absolute, the length ends the chunk at a
+    // newline which ends any token
+    chunk->input         = (String){.len = splits[i + 1], .buffer = scanner->input->buffer};
+    chunk->scanner       = *scanner;
+    chunk->scanner.input = &chunk->input;
+    chunk->scanner.index = splits[i];
+    chunk->scanner.lines   = (LineTable){};
+    chunk->scanner.symbols      = (InternTable){};
+    chunk->scanner.constants    = (ConstantTable){};
+    chunk->scanner.strings      = (StringTable){};
+    chunk->scanner.suffix_start = -1;
+  }
+  parallel_for(jobs, chunks, chunk_count, sizeof(LexChunk), lex_chunk);
+
+  // every chunk but the last ends in an EOF that is dropped, symbol ids and
+  // constant indices are local to a chunk until remapped into the scanner
+  u32 count = 1;
+  for (u32 i = 0; i < chunk_count; i++)
+  {
+    count += chunks[i].tokens.count - 1;
+  }
+
+  *tokens = (TokenBuffer){};
+  grow_token_buffer(scanner->arena, tokens, count);
+  for (u32 i = 0; i < chunk_count; i++)
+  {
+    TokenBuffer* chunk = &chunks[i].tokens;
+    u32          n     = i == chunk_count - 1 ? chunk->count : chunk->count - 1;
+    memcpy(&tokens->types[tokens->count], chunk->types, n * sizeof(u8));
+    memcpy(&tokens->offsets[tokens->count], chunk->offsets, n * sizeof(u32));
+    memcpy(&tokens->values[tokens->count], chunk->values, n * sizeof(u32));
+
+    InternTable* symbols = &chunks[i].scanner.symbols;
+    ArenaMarker  scratch = sta_get_scratch(scanner->arena);
+    u32*         remap   = sta_arena_push_array(scratch.arena, u32, symbols->count);
+    for (u32 symbol = 0; symbol < symbols->count; symbol++)
+    {
+      remap[symbol] = intern(&scanner->symbols, scanner->arena, symbol_name(symbols, symbol));
+    }
+    ConstantTable* constants = &chunks[i].scanner.constants;
+    u32            base      = scanner->constants.count;
+    for (u32 constant = 0; constant < constants->count; constant++)
+    {
+      push_constant(scanner, constants->values[constant]);
+    }
+    // decoded strings live in a worker arena, copied before it is rewound
+    StringTable* strings     = &chunks[i].scanner.strings;
+    u32          string_base = scanner->strings.count;
+    for (u32 string = 0; string < strings->count; string++)
+    {
+      String  value  = strings->values[string];
+      String* input  = scanner->input;
+      if (value.buffer < input->buffer || value.buffer >= input->buffer + input->len)
+      {
+        sta_strcpy(scanner->arena, &value, &strings->values[string]);
+      }
+      push_string(scanner, value);
+    }
+
+    for (u32 index = tokens->count; index < tokens->count + n; index++)
+    {
+      if (tokens->types[index] == TOKEN_IDENTIFIER)
+      {
+        tokens->values[index] = remap[tokens->values[index]];
+      }
+      else if (is_decoded_constant(tokens->types[index]))
+      {
+        tokens->values[index] += base;
+      }
+      else if (tokens->types[index] == TOKEN_STRING_CONSTANT)
+      {
+        tokens->values[index] += string_base;
+      }
+    }
+    tokens->count += n;
+    sta_arena_restore(scratch);
+  }
+  for (u32 i = 0; i < jobs->worker_count; i++)
+  {
+    sta_arena_restore(markers[i]);
+  }
+  scanner->index = scanner->input->len;
+}
+
+Token get_token(TokenBuffer* tokens, u32 index)
+{
+  // past the end keeps returning EOF, like parse_token does
+  index = MIN(index, tokens->count - 1);
+  return create_token(tokens->types[index], tokens->offsets[index], tokens->values[index]);
+}
+
+#define SPELLING(type, text) [type] = {.buffer = text, .len = sizeof(text) - 1}
+
+// every other token is spelled the same each time, suffixes in lowercase
+static const String spellings[] = {
+    SPELLING(TOKEN_UNSIGNED_POSTFIX, "u"),
+    SPELLING(TOKEN_LONG_POSTFIX, "l"),
+    SPELLING(TOKEN_UNSIGNED_LONG_POSTFIX, "ul"),
+    SPELLING(TOKEN_LONG_LONG_POSTFIX, "ll"),
+    SPELLING(TOKEN_UNSIGNED_LONG_LONG_POSTFIX, "ull"),
+    SPELLING(TOKEN_FLOAT_POSTFIX, "f"),
+    SPELLING(TOKEN_AUTO, "auto"),
+    SPELLING(TOKEN_BREAK, "break"),
+    SPELLING(TOKEN_CASE, "case"),
+    SPELLING(TOKEN_CHAR, "char"),
+    SPELLING(TOKEN_CONST, "const"),
+    SPELLING(TOKEN_CONTINUE, "continue"),
+    SPELLING(TOKEN_DEFAULT, "default"),
+    SPELLING(TOKEN_DO, "do"),
+    SPELLING(TOKEN_DOUBLE, "double"),
+    SPELLING(TOKEN_ELSE, "else"),
+    SPELLING(TOKEN_ENUM, "enum"),
+    SPELLING(TOKEN_EXTERN, "extern"),
+    SPELLING(TOKEN_FLOAT, "float"),
+    SPELLING(TOKEN_FOR, "for"),
+    SPELLING(TOKEN_GOTO, "goto"),
+    SPELLING(TOKEN_IF, "if"),
+    SPELLING(TOKEN_INLINE, "inline"),
+    SPELLING(TOKEN_INT, "int"),
+    SPELLING(TOKEN_LONG, "long"),
+    SPELLING(TOKEN_REGISTER, "register"),
+    SPELLING(TOKEN_RESTRICT, "restrict"),
+    SPELLING(TOKEN_RETURN, "return"),
+    SPELLING(TOKEN_SHORT, "short"),
+    SPELLING(TOKEN_SIGNED, "signed"),
+    SPELLING(TOKEN_SIZEOF, "sizeof"),
+    SPELLING(TOKEN_STATIC, "static"),
+    SPELLING(TOKEN_STRUCT, "struct"),
+    SPELLING(TOKEN_SWITCH, "switch"),
+    SPELLING(TOKEN_TYPEDEF, "typedef"),
+    SPELLING(TOKEN_UNION, "union"),
+    SPELLING(TOKEN_UNSIGNED, "unsigned"),
+    SPELLING(TOKEN_VOID, "void"),
+    SPELLING(TOKEN_VOLATILE, "volatile"),
+    SPELLING(TOKEN_WHILE, "while"),
+    SPELLING(TOKEN_BOOL, "_Bool"),
+    SPELLING(TOKEN_COMPLEX, "_Complex"),
+    SPELLING(TOKEN_IMAGINARY, "_Imaginary"),
+    SPELLING(TOKEN_LEFT_PAREN, "("),
+    SPELLING(TOKEN_RIGHT_PAREN, ")"),
+    SPELLING(TOKEN_LEFT_BRACE, "{"),
+    SPELLING(TOKEN_RIGHT_BRACE, "}"),
+    SPELLING(TOKEN_LEFT_BRACKET, "["),
+    SPELLING(TOKEN_RIGHT_BRACKET, "]"),
+    SPELLING(TOKEN_ELLIPSIS, "..."),
+    SPELLING(TOKEN_MINUS, "-"),
+    SPELLING(TOKEN_PLUS, "+"),
+    SPELLING(TOKEN_SLASH, "/"),
+    SPELLING(TOKEN_STAR, "*"),
+    SPELLING(TOKEN_MOD, "%"),
+    SPELLING(TOKEN_SHIFT_RIGHT, ">>"),
+    SPELLING(TOKEN_SHIFT_LEFT, "<<"),
+    SPELLING(TOKEN_SEMICOLON, ";"),
+    SPELLING(TOKEN_COMMA, ","),
+    SPELLING(TOKEN_DOT, "."),
+    SPELLING(TOKEN_BANG, "!"),
+    SPELLING(TOKEN_BANG_EQUAL, "!="),
+    SPELLING(TOKEN_EQUAL, "="),
+    SPELLING(TOKEN_EQUAL_EQUAL, "=="),
+    SPELLING(TOKEN_GREATER, ">"),
+    SPELLING(TOKEN_GREATER_EQUAL, ">="),
+    SPELLING(TOKEN_LESS, "<"),
+    SPELLING(TOKEN_LESS_EQUAL, "<="),
+    SPELLING(TOKEN_INCREMENT, "++"),
+    SPELLING(TOKEN_DECREMENT, "--"),
+    SPELLING(TOKEN_AND_LOGICAL, "&&"),
+    SPELLING(TOKEN_OR_LOGICAL, "||"),
+    SPELLING(TOKEN_AND_BIT, "&"),
+    SPELLING(TOKEN_OR_BIT, "|"),
+    SPELLING(TOKEN_XOR, "^"),
+    SPELLING(TOKEN_EOF, "EOF"),
+    SPELLING(TOKEN_COLON, ":"),
+};
+
+#undef SPELLING
+
+// never reads the input, which may no longer be there when streaming
+String token_literal(Scanner* scanner, Token token)
+{
+  if (token.type == TOKEN_IDENTIFIER)
+  {
+    return symbol_name(&scanner->symbols, token.value);
+  }
+  if (is_decoded_constant(token.type))
+  {
+    return get_constant(scanner, token)->literal;
+  }
+  if (token.type == TOKEN_STRING_CONSTANT)
+  {
+    // the contents, escapes decoded and adjacent literals joined
+    return scanner->strings.values[token.value];
+  }
+  return spellings[token.type];
+}
+
+Constant* get_constant(Scanner* scanner, Token token)
+{
+  return &scanner->constants.values[token.value];
+}
+
+void debug_token(Scanner* scanner, Token token)
+{
+  String literal = token_literal(scanner, token);
+  printf("%.*s", (i32)literal.len, literal.buffer);
+}
+
+// bytes starts at offset base of the whole input
+static void find_line_starts(LineTable* lines, Arena* arena, String* bytes, u32 base)
+{
+  u64 index = 0;
+  find_lines(lines, arena, bytes, &index, base);
+  for (; index < bytes->len; index++)
+  {
+    if (bytes->buffer[index] == '\n')
+    {
+      push_line_start(lines, arena, base + index + 1);
+    }
+  }
+}
+
+static void init_line_table(LineTable* lines, Arena* arena)
+{
+  lines->capacity = 64;
+  lines->starts   = sta_arena_push_array_tagged(arena, u32, lines->capacity, "LineTable");
+  push_line_start(lines, arena, 0);
+}
+
+static void build_line_table(Scanner* scanner)
+{
+  init_line_table(&scanner->lines, scanner->arena);
+  find_line_starts(&scanner->lines, scanner->arena, scanner->input, 0);
+}
+
+void get_line_column(Scanner* scanner, u32 offset, u32* line, u32* column)
+{
+  // built on first use, compiles without diagnostics never pay for it
+  if (scanner->lines.count == 0)
+  {
+    build_line_table(scanner);
+  }
+
+  // last line starting at or before offset
+  u32* starts = scanner->lines.starts;
+  u32  low    = 0;
+  u32  high   = scanner->lines.count;
+  while (high - low > 1)
+  {
+    u32 middle = low + (high - low) / 2;
+    if (starts[middle] <= offset)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  *line   = low + 1;
+  *column = offset - starts[low] + 1;
+}
+
+static void error_at_offset(Scanner* scanner, u32 offset, const char* message)
+{
+  u32 line, column;
+  get_line_column(scanner, offset, &line, &column);
+  printf("%s:%u:%u: ", scanner->filename, line, column);
+  error(message);
+}
+
+// index is into the current input, which is a window of it when streaming
+static void error_at(Scanner* scanner, i32 index, const char* message)
+{
+  error_at_offset(scanner, scanner->base + index, message);
+}
+
+void error_at_token(Scanner* scanner, Token token, const char* message)
+{
+  error_at_offset(scanner, token.offset, message);
 }
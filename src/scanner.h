@@ -4,21 +4,78 @@
 #define SCANNER_H
 #include "common.h"
 
+#include "intern.h"
+#include "jobs.h"
 #include "token.h"
 
+// offsets of the first byte of every line, line n starts at starts[n - 1]
+struct LineTable
+{
+  u32* starts;
+  u32  count;
+  u32  capacity;
+};
+typedef struct LineTable LineTable;
+
+struct ConstantTable
+{
+  Constant* values;
+  u32       count;
+  u32       capacity;
+};
+typedef struct ConstantTable ConstantTable;
+
+// contents of string literals, slices of the input unless escaped or joined
+struct StringTable
+{
+  String* values;
+  u32     count;
+  u32     capacity;
+};
+typedef struct StringTable StringTable;
+
+// input read from a file descriptor through a fixed window instead of held
+// whole, see init_stream_scanner
+struct Stream
+{
+  String window;
+  u64    capacity;
+  i32    fd;
+  bool   eof;
+};
+typedef struct Stream Stream;
+
 struct Scanner
 {
-  Arena*  arena;
-  String* input;
-  i32     index;
-  i32     line;
-  u8*     filename;
+  Arena*        arena;
+  String*       input;
+  i32           index;
+  u8*           filename;
+  LineTable     lines;
+  InternTable   symbols;
+  ConstantTable constants;
+  StringTable   strings;
+  i32           suffix_start; // where the suffix of the last constant begins
+  u32           base;         // offset of input->buffer in the whole input
+  Stream*       stream;       // 0 when the input is held whole
 };
 
 typedef struct Scanner Scanner;
 
+// the byte after the input has to end any token, the 0 that sta_read_file
+// and sta_map_file leave there does
 void init_scanner(Scanner* scanner, Arena* arena, String* literal, const char* filename);
+void init_stream_scanner(Scanner* scanner, Arena* arena, i32 fd, u64 window_size, const char* filename);
 void error(const char * msg);
-Token*                 parse_token(Scanner* scanner);
+void                   error_at_token(Scanner* scanner, Token token, const char* msg);
+Token                  parse_token(Scanner* scanner);
+TokenType              get_keyword(String literal);
+void                   scan_tokens(Scanner* scanner, TokenBuffer* tokens);
+void                   scan_tokens_parallel(Scanner* scanner, TokenBuffer* tokens, JobSystem* jobs, u32 chunk_count);
+Token                  get_token(TokenBuffer* tokens, u32 index);
+String                 token_literal(Scanner* scanner, Token token);
+Constant*              get_constant(Scanner* scanner, Token token);
+void                   debug_token(Scanner* scanner, Token token);
+void                   get_line_column(Scanner* scanner, u32 offset, u32* line, u32* column);
 
 #endif
@@ -0,0 +1,107 @@
+#include "symbol_table.h"
+#include "common.h"
+#include <string.h>
+
+// most blocks declare no types at all
+#define SCOPE_SLOTS 16
+
+// the ids are dense, the multiply spreads neighbours over the slots
+static u32 hash_symbol(u32 symbol)
+{
+  return symbol * 0x9E3779B1;
+}
+
+static void init_slots(SymbolTable* table, Scope* scope, u32 slot_count)
+{
+  scope->slots      = sta_arena_push_array_tagged(table->arena, u32, slot_count, "SymbolTable");
+  scope->kinds      = sta_arena_push_array_tagged(table->arena, u8, slot_count, "SymbolTable");
+  scope->slot_count = slot_count;
+  memset(scope->slots, 0, slot_count * sizeof(u32));
+}
+
+static u32 find_slot(Scope* scope, u32 symbol)
+{
+  u32 slot = hash_symbol(symbol) & (scope->slot_count - 1);
+  while (scope->slots[slot] != 0 && scope->slots[slot] != symbol + 1)
+  {
+    slot = (slot + 1) & (scope->slot_count - 1);
+  }
+  return slot;
+}
+
+// slots stay at most half full, the old ones are left until the scope closes
+static void grow_scope(SymbolTable* table, Scope* scope)
+{
+  u32* slots      = scope->slots;
+  u8*  kinds      = scope->kinds;
+  u32  slot_count = scope->slot_count;
+  init_slots(table, scope, slot_count * 2);
+  for (u32 i = 0; i < slot_count; i++)
+  {
+    if (slots[i] != 0)
+    {
+      u32 slot           = find_slot(scope, slots[i] - 1);
+      scope->slots[slot] = slots[i];
+      scope->kinds[slot] = kinds[i];
+    }
+  }
+}
+
+void init_symbol_table(SymbolTable* table, Arena* arena)
+{
+  table->arena = arena;
+  table->scope = 0;
+}
+
+void push_scope(SymbolTable* table)
+{
+  ArenaMarker start = sta_arena_save(table->arena);
+  Scope*      scope = sta_arena_push_struct(table->arena, Scope);
+  scope->parent     = table->scope;
+  scope->start      = start;
+  scope->count      = 0;
+  init_slots(table, scope, SCOPE_SLOTS);
+  table->scope = scope;
+}
+
+void pop_scope(SymbolTable* table)
+{
+  Scope* scope = table->scope;
+  table->scope = scope->parent;
+  sta_arena_restore(scope->start);
+}
+
+// declaring a name again in the same scope replaces it
+void declare_symbol(SymbolTable* table, u32 symbol, SymbolKind kind)
+{
+  Scope* scope = table->scope;
+  if ((scope->count + 1) * 2 > scope->slot_count)
+  {
+    grow_scope(table, scope);
+  }
+
+  u32 slot = find_slot(scope, symbol);
+  if (scope->slots[slot] == 0)
+  {
+    scope->count++;
+  }
+  scope->slots[slot] = symbol + 1;
+  scope->kinds[slot] = kind;
+}
+
+bool lookup_symbol(SymbolTable* table, u32 symbol, SymbolKind* kind)
+{
+  for (Scope* scope = table->scope; scope; scope = scope->parent)
+  {
+    u32 slot = find_slot(scope, symbol);
+    if (scope->slots[slot] != 0)
+    {
+      if (kind)
+      {
+        *kind = scope->kinds[slot];
+      }
+      return true;
+    }
+  }
+  return false;
+}
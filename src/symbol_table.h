@@ -0,0 +1,43 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+#include "common.h"
+
+typedef enum
+{
+  SYMBOL_STRUCT,
+  SYMBOL_UNION,
+  SYMBOL_ENUM,
+  SYMBOL_TYPEDEF
+} SymbolKind;
+
+/*
+  A scope is its own open addressed table keyed on the interned ids, made
+  in the arena right after the scope it's nested in. Names are only ever
+  declared in the innermost scope, so everything a scope grows into is
+  past where it started and closing it is restoring the marker. A lookup
+  probes from the innermost scope out, which is as deep as the blocks go.
+*/
+typedef struct Scope Scope;
+struct Scope
+{
+  Scope*      parent;
+  ArenaMarker start;
+  u32*        slots; // id + 1, 0 is empty
+  u8*         kinds;
+  u32         count;
+  u32         slot_count;
+};
+
+typedef struct
+{
+  Arena* arena;
+  Scope* scope; // innermost
+} SymbolTable;
+
+void init_symbol_table(SymbolTable* table, Arena* arena);
+void push_scope(SymbolTable* table);
+void pop_scope(SymbolTable* table);
+void declare_symbol(SymbolTable* table, u32 symbol, SymbolKind kind);
+bool lookup_symbol(SymbolTable* table, u32 symbol, SymbolKind* kind);
+
+#endif
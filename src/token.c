@@ -2,13 +2,12 @@
 #include "common.h"
 #include <stdio.h>
 
-Token* create_token(Arena* arena, TokenType type, String literal, int line, int index)
+Token create_token(TokenType type, u32 offset, u32 value)
 {
-  Token* token   = sta_arena_push_struct(arena, Token);
-  token->type    = type;
-  token->literal = literal;
-  token->line    = line;
-  token->index   = index;
+  Token token  = {};
+  token.type   = type;
+  token.offset = offset;
+  token.value  = value;
   return token;
 }
 
@@ -25,11 +24,3 @@ const char* get_token_type_string(TokenType type)
 
   return token_names[type];
 }
-
-void debug_token(Token* token)
-{
-
-  printf("%.*s", (i32)token->literal.len, token->literal.buffer);
-  // printf("%s %.*s @%d\n", token_names[token->type], (int)token->literal.len,
-  // token->literal.buffer, token->line);
-}
@@ -14,6 +14,13 @@ enum TokenType
   TOKEN_INT_CONSTANT,
   TOKEN_INT_HEX_CONSTANT,
   TOKEN_STRING_CONSTANT,
+  // SUFFIXES, lexed right after the constant they belong to
+  TOKEN_UNSIGNED_POSTFIX,
+  TOKEN_LONG_POSTFIX,
+  TOKEN_UNSIGNED_LONG_POSTFIX,
+  TOKEN_LONG_LONG_POSTFIX,
+  TOKEN_UNSIGNED_LONG_LONG_POSTFIX,
+  TOKEN_FLOAT_POSTFIX,
   // KEYWORDS
   TOKEN_AUTO,
   TOKEN_BREAK,
@@ -91,17 +98,63 @@ enum TokenType
 };
 typedef enum TokenType TokenType;
 
+// the token starts at offset, line and column are recovered from it only
+// when needed. value is the symbol id for identifiers, the index of the
+// decoded constant for numbers and characters and the length of the literal
+// for everything else
 struct Token
 {
-  TokenType type;
-  String    literal;
-  i32       index;
-  i32       line;
+  u32 offset;
+  u32 type  : 8;
+  u32 value : 24;
 };
 typedef struct Token Token;
+_Static_assert(sizeof(Token) == 8, "Token should pack into 8 bytes");
 
-Token*               create_token(Arena* arena, TokenType type, String literal, i32 line, i32 index);
-void                 debug_token(Token* token);
+// unsigned classes are odd, each class is at least as wide as the one before
+typedef enum
+{
+  CONSTANT_INT,
+  CONSTANT_UNSIGNED_INT,
+  CONSTANT_LONG,
+  CONSTANT_UNSIGNED_LONG,
+  CONSTANT_LONG_LONG,
+  CONSTANT_UNSIGNED_LONG_LONG,
+  CONSTANT_FLOAT,
+  CONSTANT_DOUBLE,
+  CONSTANT_LONG_DOUBLE,
+} ConstantClass;
+
+// a number or character constant decoded once by the scanner, the type
+// follows C11 6.4.4.1 from the value, base and suffix
+struct Constant
+{
+  union
+  {
+    u64 integer;
+    f64 floating;
+  };
+  String literal; // without the suffix
+  u8     class;
+};
+typedef struct Constant Constant;
+
+/*
+  A whole input lexed up front, one entry per token spread over parallel
+  arrays so walking it touches memory sequentially. The last token is
+  always TOKEN_EOF.
+*/
+struct TokenBuffer
+{
+  u8*  types;
+  u32* offsets;
+  u32* values;
+  u32  count;
+  u32  capacity;
+};
+typedef struct TokenBuffer TokenBuffer;
+
+Token                create_token(TokenType type, u32 offset, u32 value);
 const char*          get_token_type_string(TokenType type);
 
 #endif
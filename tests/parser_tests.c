@@ -0,0 +1,180 @@
+#include "../src/files.h"
+#include "../src/parser.h"
+#include "../src/scanner.h"
+#include "test_common.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the statements of the body of the first function in the file
+static u32* parse_body(Parser* parser, Scanner* scanner, Arena* arena, String* file, const char* path, u32* count)
+{
+  if (!sta_read_file(arena, file, path))
+  {
+    return 0;
+  }
+  init_scanner(scanner, arena, file, path);
+  init_parser(parser, scanner, 0);
+  Ast*      ast      = parse(parser);
+  NodeIndex function = 0;
+  for (u32 i = 0; i < list_count(ast, ast->root) && !function; i++)
+  {
+    NodeIndex node = list_items(ast, ast->root)[i];
+    function       = ast->kinds[node] == NODE_FUNCTION ? node : 0;
+  }
+  NodeIndex body = ast->extra[ast->data[function].rhs];
+  *count         = list_count(ast, ast->data[body].lhs);
+  return list_items(ast, ast->data[body].lhs);
+}
+
+static void test_assignment()
+{
+  const char* name = "test_assignment";
+  print_test_running(name);
+
+  Scanner scanner = {};
+  Parser  parser  = {};
+  Arena   arena   = {};
+  sta_arena_init_heap(&arena, 4096 * 16);
+  String file = {};
+  u32    count;
+  u32*   statements = parse_body(&parser, &scanner, &arena, &file, "./tests/test_assignment.jc", &count);
+  if (!statements)
+  {
+    print_test_fail_setup(name, "Failed to read file \"test_assignment.jc\"");
+    return;
+  }
+
+  // a = (b = c), then the comparison a == b
+  Ast*     ast    = &parser.ast;
+  NodeData assign = ast->data[statements[0]];
+  free_parser(&parser);
+  if (count != 2 || ast->kinds[statements[0]] != NODE_ASSIGN || ast->kinds[assign.lhs] != NODE_IDENTIFIER || ast->kinds[assign.rhs] != NODE_ASSIGN ||
+      ast->kinds[ast->data[assign.rhs].lhs] != NODE_IDENTIFIER || ast->kinds[ast->data[assign.rhs].rhs] != NODE_IDENTIFIER)
+  {
+    free((void*)arena.memory);
+    print_test_fail(name, "a = (b = c)", "something else");
+    return;
+  }
+  if (ast->kinds[statements[1]] != NODE_COMPARISON || ast->tokens[statements[1]].type != TOKEN_EQUAL_EQUAL)
+  {
+    free((void*)arena.memory);
+    print_test_fail(name, "a == b", "something else");
+    return;
+  }
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
+static void test_scopes()
+{
+  const char* name = "test_scopes";
+  print_test_running(name);
+
+  Arena arena = {};
+  sta_arena_init_heap(&arena, 4096 * 16);
+  SymbolTable table = {};
+  init_symbol_table(&table, &arena);
+  push_scope(&table);
+  declare_symbol(&table, 1, SYMBOL_STRUCT);
+
+  u64 outer = arena.ptr;
+  push_scope(&table);
+  declare_symbol(&table, 1, SYMBOL_TYPEDEF);
+  // enough to grow the inner table a few times
+  for (u32 symbol = 2; symbol < 200; symbol++)
+  {
+    declare_symbol(&table, symbol, SYMBOL_ENUM);
+  }
+
+  SymbolKind kind;
+  bool       shadowed = lookup_symbol(&table, 1, &kind) && kind == SYMBOL_TYPEDEF;
+  bool       grown    = true;
+  for (u32 symbol = 2; symbol < 200; symbol++)
+  {
+    grown &= lookup_symbol(&table, symbol, &kind) && kind == SYMBOL_ENUM;
+  }
+  pop_scope(&table);
+  bool restored = lookup_symbol(&table, 1, &kind) && kind == SYMBOL_STRUCT && !lookup_symbol(&table, 2, 0) && arena.ptr == outer;
+  pop_scope(&table);
+  bool empty = !lookup_symbol(&table, 1, 0);
+  free((void*)arena.memory);
+
+  if (!shadowed)
+  {
+    print_test_fail(name, "inner typedef", "outer struct");
+    return;
+  }
+  if (!grown)
+  {
+    print_test_fail(name, "every symbol after growing", "missing symbol");
+    return;
+  }
+  if (!restored || !empty)
+  {
+    print_test_fail(name, "outer binding after pop", "inner binding");
+    return;
+  }
+
+  print_test_complete(name);
+}
+
+static void test_type_names()
+{
+  const char* name = "test_type_names";
+  print_test_running(name);
+
+  Scanner scanner = {};
+  Parser  parser  = {};
+  Arena   arena   = {};
+  sta_arena_init_heap(&arena, 4096 * 16);
+  String file = {};
+  u32    count;
+  u32*   statements = parse_body(&parser, &scanner, &arena, &file, "./tests/test_type_names.jc", &count);
+  if (!statements)
+  {
+    print_test_fail_setup(name, "Failed to read file \"test_type_names.jc\"");
+    return;
+  }
+  free_parser(&parser);
+
+  // point p; and size n; are declarations of the named types, the block declares inner i;
+  Ast*        ast      = &parser.ast;
+  const char* expected = "point p; size n; { inner i; }";
+  if (count != 3 || ast->kinds[statements[2]] != NODE_BLOCK || list_count(ast, ast->data[statements[2]].lhs) != 2)
+  {
+    free((void*)arena.memory);
+    print_test_fail(name, expected, "other statements");
+    return;
+  }
+  NodeIndex   declarations[] = {statements[0], statements[1], list_items(ast, ast->data[statements[2]].lhs)[1]};
+  const char* names[]        = {"point", "size", "inner"};
+  for (int i = 0; i < ArrayCount(declarations); i++)
+  {
+    NodeIndex declaration = declarations[i];
+    if (ast->kinds[declaration] != NODE_DECLARATION || ast->types[ast->data[declaration].lhs].type != DATA_TYPE_STRUCT)
+    {
+      free((void*)arena.memory);
+      print_test_fail(name, expected, "not a declaration");
+      return;
+    }
+    String type = symbol_name(&scanner.symbols, ast->types[ast->data[declaration].lhs].strukt.symbol);
+    if (type.len != strlen(names[i]) || memcmp(type.buffer, names[i], type.len) != 0)
+    {
+      free((void*)arena.memory);
+      print_test_fail(name, names[i], "another type");
+      return;
+    }
+  }
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
+void run_parser_tests()
+{
+  test_assignment();
+  test_scopes();
+  test_type_names();
+}
@@ -0,0 +1,6 @@
+#ifndef PARSER_TESTS_H
+#define PARSER_TESTS_H
+
+void run_parser_tests();
+
+#endif
@@ -1,8 +1,11 @@
 #include "../src/files.h"
 #include "../src/scanner.h"
 #include "test_common.h"
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 static void test_constants()
 {
@@ -40,26 +43,447 @@ static void test_constants()
 
   for (int i = 0; i < ArrayCount(tokens); i++)
   {
-    Token* out = parse_token(&scanner);
-    if (tokens[i] != out->type)
+    Token out = parse_token(&scanner);
+    if (tokens[i] != out.type)
     {
       free((void*)arena.memory);
-      print_test_fail(name, get_token_type_string(tokens[i]), get_token_type_string(out->type));
+      print_test_fail(name, get_token_type_string(tokens[i]), get_token_type_string(out.type));
       return;
     }
   }
-  Token* out = parse_token(&scanner);
+  Token out = parse_token(&scanner);
   free((void*)arena.memory);
-  if (out->type != TOKEN_EOF)
+  if (out.type != TOKEN_EOF)
   {
-    print_test_fail(name, get_token_type_string(TOKEN_EOF), get_token_type_string(out->type));
+    print_test_fail(name, get_token_type_string(TOKEN_EOF), get_token_type_string(out.type));
     return;
   }
 
   print_test_complete(name);
 }
 
+static void test_constant_values()
+{
+  const char* name = "test_constant_values";
+  print_test_running(name);
+
+  Scanner scanner = {};
+  Arena   arena   = {};
+  sta_arena_init_heap(&arena, 4096 * 4);
+  String input = {};
+  sta_initString(&input, "15 0x15 056 '5' 5.25 15ll 0x15l 056u 0x01.5p10f 2147483648 0xFFFFFFFF 4294967296u 0b101 .5e1 "
+                         "0.1 1e23 2.2250738585072011e-308 123456789012345678901234567890.0 0x1p-1074 1.5L 01.5 0123e4 0637626603567196575.4 0");
+
+  init_scanner(&scanner, &arena, &input, "scanner_test.jc");
+
+  u64 integers[]  = {15, 0x15, 056, '5', 15, 0x15, 056, 2147483648, 0xFFFFFFFF, 4294967296, 5, 0};
+  u8  classes[]   = {CONSTANT_INT, CONSTANT_INT, CONSTANT_INT, CONSTANT_INT, CONSTANT_DOUBLE, CONSTANT_LONG_LONG, CONSTANT_LONG, CONSTANT_UNSIGNED_INT, CONSTANT_FLOAT,
+                     CONSTANT_LONG, CONSTANT_UNSIGNED_INT, CONSTANT_UNSIGNED_LONG, CONSTANT_INT, CONSTANT_DOUBLE, CONSTANT_DOUBLE, CONSTANT_DOUBLE, CONSTANT_DOUBLE,
+                     CONSTANT_DOUBLE, CONSTANT_DOUBLE, CONSTANT_LONG_DOUBLE, CONSTANT_DOUBLE, CONSTANT_DOUBLE, CONSTANT_DOUBLE, CONSTANT_INT};
+  // a leading 0 doesn't make a float octal
+  f64 floatings[] = {5.25, 0x01.5p10, 5, 0.1, 1e23, 2.2250738585072011e-308, 123456789012345678901234567890.0, 0x1p-1074, 1.5, 01.5, 0123e4, 0637626603567196575.4};
+
+  u32 integer = 0, floating = 0;
+  for (int i = 0; i < ArrayCount(classes); i++)
+  {
+    Token out = parse_token(&scanner);
+    if (out.type >= TOKEN_UNSIGNED_POSTFIX && out.type <= TOKEN_FLOAT_POSTFIX)
+    {
+      out = parse_token(&scanner);
+    }
+    Constant* constant = get_constant(&scanner, out);
+    bool      is_float = constant->class >= CONSTANT_FLOAT;
+    bool      ok       = constant->class == classes[i];
+    if (is_float)
+    {
+      ok &= constant->floating == floatings[floating++];
+    }
+    else
+    {
+      ok &= constant->integer == integers[integer++];
+    }
+    if (!ok)
+    {
+      char expected[32], got[64];
+      String literal = token_literal(&scanner, out);
+      sprintf(expected, "class %u", classes[i]);
+      sprintf(got, "%.*s class %u", (i32)literal.len, literal.buffer, constant->class);
+      free((void*)arena.memory);
+      print_test_fail(name, expected, got);
+      return;
+    }
+  }
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
+static void test_keywords()
+{
+  const char* name = "test_keywords";
+  print_test_running(name);
+
+  const char* keywords[] = {"auto",   "break",  "case",    "char",   "const",    "continue", "default",  "do",       "double", "else",     "enum",      "extern", "float",
+                            "for",    "goto",   "if",      "inline", "int",      "long",     "register", "restrict", "return", "short",    "signed",    "sizeof", "static",
+                            "struct", "switch", "typedef", "union",  "unsigned", "void",     "volatile", "while",    "_Bool",  "_Complex", "_Imaginary"};
+  TokenType   tokens[]   = {
+      TOKEN_AUTO,   TOKEN_BREAK,  TOKEN_CASE,    TOKEN_CHAR,   TOKEN_CONST,    TOKEN_CONTINUE, TOKEN_DEFAULT,  TOKEN_DO,       TOKEN_DOUBLE, TOKEN_ELSE,    TOKEN_ENUM,      TOKEN_EXTERN, TOKEN_FLOAT,
+      TOKEN_FOR,    TOKEN_GOTO,   TOKEN_IF,      TOKEN_INLINE, TOKEN_INT,      TOKEN_LONG,     TOKEN_REGISTER, TOKEN_RESTRICT, TOKEN_RETURN, TOKEN_SHORT,   TOKEN_SIGNED,    TOKEN_SIZEOF, TOKEN_STATIC,
+      TOKEN_STRUCT, TOKEN_SWITCH, TOKEN_TYPEDEF, TOKEN_UNION,  TOKEN_UNSIGNED, TOKEN_VOID,     TOKEN_VOLATILE, TOKEN_WHILE,    TOKEN_BOOL,   TOKEN_COMPLEX, TOKEN_IMAGINARY,
+  };
+
+  for (int i = 0; i < ArrayCount(keywords); i++)
+  {
+    String literal = {};
+    sta_initString(&literal, keywords[i]);
+    if (get_keyword(literal) != tokens[i])
+    {
+      print_test_fail(name, keywords[i], "TOKEN_IDENTIFIER");
+      return;
+    }
+  }
+
+  // same length, first and last character as a keyword
+  const char* identifiers[] = {"cate", "whale", "unsiqned", "sizeoff", "i", "_Bool_", "struct_", "x"};
+  for (int i = 0; i < ArrayCount(identifiers); i++)
+  {
+    String literal = {};
+    sta_initString(&literal, identifiers[i]);
+    if (get_keyword(literal) != TOKEN_IDENTIFIER)
+    {
+      print_test_fail(name, "TOKEN_IDENTIFIER", identifiers[i]);
+      return;
+    }
+  }
+
+  print_test_complete(name);
+}
+
+static void test_symbols()
+{
+  const char* name = "test_symbols";
+  print_test_running(name);
+
+  Scanner scanner = {};
+  Arena   arena   = {};
+  sta_arena_init_heap(&arena, 4096);
+  String input = {};
+  sta_initString(&input, "count counter c count an_identifier_longer_than_sixteen counter an_identifier_longer_than_sixteen_");
+
+  init_scanner(&scanner, &arena, &input, "scanner_test.jc");
+
+  // ids are handed out in order of first appearance
+  u32 symbols[] = {0, 1, 2, 0, 3, 1, 4};
+  for (int i = 0; i < ArrayCount(symbols); i++)
+  {
+    Token  out     = parse_token(&scanner);
+    String literal = token_literal(&scanner, out);
+    if (out.type != TOKEN_IDENTIFIER || out.value != symbols[i] || memcmp(literal.buffer, &input.buffer[out.offset], literal.len) != 0 ||
+        !sta_strcmp(&literal, &scanner.symbols.names[out.value]))
+    {
+      char expected[32], got[32];
+      sprintf(expected, "%u", symbols[i]);
+      sprintf(got, "%u %.*s", out.value, (i32)literal.len, literal.buffer);
+      free((void*)arena.memory);
+      print_test_fail(name, expected, got);
+      return;
+    }
+  }
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
+static void test_strings()
+{
+  const char* name = "test_strings";
+  print_test_running(name);
+
+  Scanner scanner = {};
+  Arena   arena   = {};
+  sta_arena_init_heap(&arena, 4096);
+  String input = {};
+  sta_initString(&input, "\"plain\"; \"a\\\"b\"; \"\\t\\x41\\101\\\\\\0\"; \"joined \" // comment\n /* more */ \"pieces\"; \"\" \"\"");
+
+  init_scanner(&scanner, &arena, &input, "scanner_test.jc");
+
+  const char* expected[] = {"plain", "a\"b", "\tAA\\", "joined pieces"};
+  u64         lengths[]  = {5, 3, 5, 13};
+  for (int i = 0; i < ArrayCount(expected); i++)
+  {
+    Token  out     = parse_token(&scanner);
+    String literal = token_literal(&scanner, out);
+    if (out.type != TOKEN_STRING_CONSTANT || literal.len != lengths[i] || memcmp(literal.buffer, expected[i], lengths[i]) != 0 ||
+        parse_token(&scanner).type != TOKEN_SEMICOLON)
+    {
+      free((void*)arena.memory);
+      print_test_fail(name, expected[i], "a different string");
+      return;
+    }
+  }
+  // without escapes the literal is a slice of the input
+  if (scanner.strings.values[0].buffer != &input.buffer[1])
+  {
+    free((void*)arena.memory);
+    print_test_fail(name, "a slice of the input", "a copy");
+    return;
+  }
+
+  Token  out     = parse_token(&scanner);
+  String literal = token_literal(&scanner, out);
+  free((void*)arena.memory);
+  if (out.type != TOKEN_STRING_CONSTANT || literal.len != 0 || parse_token(&scanner).type != TOKEN_EOF)
+  {
+    print_test_fail(name, "an empty string", "something else");
+    return;
+  }
+
+  print_test_complete(name);
+}
+
+static void test_batch_tokens()
+{
+  const char* name = "test_batch_tokens";
+  print_test_running(name);
+
+  Arena arena = {};
+  sta_arena_init_heap(&arena, 4096 * 4);
+  String file = {};
+
+  if (!sta_read_file(&arena, &file, "./tests/test_constants.jc"))
+  {
+    print_test_fail_setup(name, "Failed to read file \"test_constants.jc\"");
+    return;
+  }
+
+  Scanner lazy  = {};
+  Scanner batch = {};
+  init_scanner(&lazy, &arena, &file, "scanner_test.jc");
+  init_scanner(&batch, &arena, &file, "scanner_test.jc");
+
+  TokenBuffer tokens = {};
+  scan_tokens(&batch, &tokens);
+
+  for (u32 i = 0; i < tokens.count; i++)
+  {
+    Token expected = parse_token(&lazy);
+    Token out      = get_token(&tokens, i);
+    if (expected.type != out.type || expected.offset != out.offset || expected.value != out.value)
+    {
+      free((void*)arena.memory);
+      print_test_fail(name, get_token_type_string(expected.type), get_token_type_string(out.type));
+      return;
+    }
+  }
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
+static void test_parallel_tokens()
+{
+  const char* name = "test_parallel_tokens";
+  print_test_running(name);
+
+  // more chunks than workers, so some are stolen and some wait in a deque
+  JobSystem jobs = {};
+  init_job_system(&jobs, 4);
+
+  // test_split.jc hides newlines, quotes and comment markers inside strings and comments
+  const char* files[] = {"./tests/test_constants.jc", "./tests/test_split.jc"};
+  for (int f = 0; f < ArrayCount(files); f++)
+  {
+    Arena arena = {};
+    sta_arena_init_heap(&arena, 4096 * 16);
+    String file = {};
+
+    if (!sta_read_file(&arena, &file, files[f]))
+    {
+      shutdown_job_system(&jobs);
+      print_test_fail_setup(name, "Failed to read test file");
+      return;
+    }
+
+    Scanner serial = {};
+    init_scanner(&serial, &arena, &file, "scanner_test.jc");
+    TokenBuffer expected = {};
+    scan_tokens(&serial, &expected);
+
+    for (u32 chunk_count = 1; chunk_count <= 8; chunk_count++)
+    {
+      Scanner parallel = {};
+      init_scanner(&parallel, &arena, &file, "scanner_test.jc");
+      TokenBuffer tokens = {};
+      scan_tokens_parallel(&parallel, &tokens, &jobs, chunk_count);
+
+      for (u32 i = 0; i < expected.count; i++)
+      {
+        Token want = get_token(&expected, i);
+        Token out  = i < tokens.count ? get_token(&tokens, i) : (Token){};
+        if (tokens.count != expected.count || want.type != out.type || want.offset != out.offset || want.value != out.value)
+        {
+          char wanted[32], got[32];
+          sprintf(wanted, "%u tokens, %u@%u", expected.count, want.type, want.offset);
+          sprintf(got, "%u tokens, %u@%u", tokens.count, out.type, out.offset);
+          free((void*)arena.memory);
+          shutdown_job_system(&jobs);
+          print_test_fail(name, wanted, got);
+          return;
+        }
+      }
+    }
+    free((void*)arena.memory);
+  }
+  shutdown_job_system(&jobs);
+
+  print_test_complete(name);
+}
+
+static void test_stream_tokens()
+{
+  const char* name = "test_stream_tokens";
+  print_test_running(name);
+
+  // a window small enough that both files take several refills
+  const char* files[] = {"./tests/test_constants.jc", "./tests/test_split.jc"};
+  for (int f = 0; f < ArrayCount(files); f++)
+  {
+    Arena arena = {};
+    sta_arena_init_heap(&arena, 4096 * 16);
+    String file = {};
+    i32    fd   = open(files[f], O_RDONLY);
+    if (fd < 0 || !sta_read_file(&arena, &file, files[f]))
+    {
+      print_test_fail_setup(name, "Failed to read test file");
+      return;
+    }
+
+    Scanner whole = {};
+    init_scanner(&whole, &arena, &file, "scanner_test.jc");
+    TokenBuffer expected = {};
+    scan_tokens(&whole, &expected);
+
+    Scanner stream = {};
+    init_stream_scanner(&stream, &arena, fd, 160, "scanner_test.jc");
+    for (u32 i = 0; i < expected.count; i++)
+    {
+      Token  want = get_token(&expected, i);
+      Token  out  = parse_token(&stream);
+      String a    = token_literal(&whole, want);
+      String b    = token_literal(&stream, out);
+      u32    want_line, want_column, line, column;
+      get_line_column(&whole, want.offset, &want_line, &want_column);
+      get_line_column(&stream, out.offset, &line, &column);
+      if (want.type != out.type || want.offset != out.offset || !sta_strcmp(&a, &b) || want_line != line || want_column != column)
+      {
+        char wanted[64], got[64];
+        sprintf(wanted, "%u@%u:%u %.*s", want.type, want_line, want_column, (i32)a.len, a.buffer);
+        sprintf(got, "%u@%u:%u %.*s", out.type, line, column, (i32)b.len, b.buffer);
+        close(fd);
+        free((void*)arena.memory);
+        print_test_fail(name, wanted, got);
+        return;
+      }
+    }
+    close(fd);
+    free((void*)arena.memory);
+  }
+
+  print_test_complete(name);
+}
+
+static void test_mapped_input()
+{
+  const char* name = "test_mapped_input";
+  print_test_running(name);
+
+  Arena arena = {};
+  sta_arena_init_heap(&arena, 4096 * 16);
+  String file   = {};
+  String mapped = {};
+  if (!sta_read_file(&arena, &file, "./tests/test_split.jc") || !sta_map_file(&mapped, "./tests/test_split.jc"))
+  {
+    print_test_fail_setup(name, "Failed to read test file");
+    return;
+  }
+
+  Scanner read = {};
+  init_scanner(&read, &arena, &file, "scanner_test.jc");
+  TokenBuffer expected = {};
+  scan_tokens(&read, &expected);
+
+  // the scanner relies on the 0 after the last byte
+  Scanner scanner = {};
+  init_scanner(&scanner, &arena, &mapped, "scanner_test.jc");
+  TokenBuffer tokens = {};
+  scan_tokens(&scanner, &tokens);
+  if (mapped.len != file.len || mapped.buffer[mapped.len] != 0 || tokens.count != expected.count ||
+      memcmp(tokens.types, expected.types, tokens.count) != 0 || memcmp(tokens.offsets, expected.offsets, tokens.count * sizeof(u32)) != 0)
+  {
+    char wanted[32], got[32];
+    sprintf(wanted, "%u tokens", expected.count);
+    sprintf(got, "%u tokens", tokens.count);
+    sta_unmap_file(&mapped);
+    free((void*)arena.memory);
+    print_test_fail(name, wanted, got);
+    return;
+  }
+  sta_unmap_file(&mapped);
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
+static void test_line_column()
+{
+  const char* name = "test_line_column";
+  print_test_running(name);
+
+  Scanner scanner = {};
+  Arena   arena   = {};
+  sta_arena_init_heap(&arena, 4096);
+  String file = {};
+
+  if (!sta_read_file(&arena, &file, "./tests/test_constants.jc"))
+  {
+    print_test_fail_setup(name, "Failed to read file \"test_constants.jc\"");
+    return;
+  }
+
+  init_scanner(&scanner, &arena, &file, "scanner_test.jc");
+
+  // line 6 is empty, the suffixes share a line with their constant
+  u32 lines[]   = {1, 2, 3, 4, 5, 7, 7, 8, 8, 9, 9, 10, 10};
+  u32 columns[] = {1, 1, 1, 2, 1, 1, 3, 1, 5, 1, 4, 1, 10};
+  for (int i = 0; i < ArrayCount(lines); i++)
+  {
+    Token out = parse_token(&scanner);
+    u32   line, column;
+    get_line_column(&scanner, out.offset, &line, &column);
+    if (line != lines[i] || column != columns[i])
+    {
+      char got[32];
+      sprintf(got, "%u:%u", line, column);
+      free((void*)arena.memory);
+      print_test_fail(name, get_token_type_string(out.type), got);
+      return;
+    }
+  }
+  free((void*)arena.memory);
+
+  print_test_complete(name);
+}
+
 void run_scanner_tests()
 {
   test_constants();
+  test_constant_values();
+  test_keywords();
+  test_symbols();
+  test_strings();
+  test_batch_tokens();
+  test_parallel_tokens();
+  test_stream_tokens();
+  test_mapped_input();
+  test_line_column();
 }
@@ -1,6 +1,8 @@
+#include "parser_tests.h"
 #include "scanner_tests.h"
 
 
 int main(){
   run_scanner_tests();
+  run_parser_tests();
 }